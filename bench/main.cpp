@@ -0,0 +1,261 @@
+#include <Luau/ParseOptions.h>
+#include <Luau/Parser.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "minifier.h"
+#include "output.h"
+#include "source.h"
+#include "syntax.h"
+#include "tracking.h"
+
+/*
+  Micro-benchmarks for every phase of the minifier, run over the checked-in
+  corpus (bench/corpus) or the files given on the command line.
+
+  Every phase is repeated until it ran for at least --time milliseconds, and is
+  reported in nanoseconds per source byte, nanoseconds per run and heap
+  allocations (count and bytes) per run. Phases only measure themselves: the
+  parse tree, AstTracking and Glue they depend on are built once up front.
+*/
+
+static std::atomic<size_t> allocationCount = 0;
+static std::atomic<size_t> allocationBytes = 0;
+
+void *operator new(size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  allocationBytes.fetch_add(size, std::memory_order_relaxed);
+
+  if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+    return pointer;
+  }
+
+  throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete[](void *pointer) noexcept { std::free(pointer); }
+
+struct PhaseResult {
+  size_t iterations = 0;
+  double nanoseconds = 0; // per iteration
+  double allocations = 0; // per iteration
+  double bytes = 0;       // allocated per iteration
+};
+
+static PhaseResult measure(const std::function<void()> &phase,
+                           std::chrono::milliseconds minimumTime) {
+  using clock = std::chrono::steady_clock;
+
+  phase(); // warm up caches and thread_local state
+
+  PhaseResult result = {};
+  size_t count = allocationCount.load();
+  size_t bytes = allocationBytes.load();
+  clock::time_point start = clock::now();
+  clock::duration elapsed = {};
+
+  do {
+    phase();
+
+    result.iterations++;
+    elapsed = clock::now() - start;
+  } while (elapsed < minimumTime);
+
+  const double iterations = static_cast<double>(result.iterations);
+
+  result.nanoseconds =
+      std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+  result.allocations = (allocationCount.load() - count) / iterations;
+  result.bytes = (allocationBytes.load() - bytes) / iterations;
+
+  return result;
+}
+
+static void report(const char *phase, size_t sourceSize,
+                   const PhaseResult &result) {
+  std::printf("  %-16s %10.2f ns/byte %14.0f ns %12.1f allocs %14.0f bytes"
+              " (%zu runs)\n",
+              phase, result.nanoseconds / sourceSize, result.nanoseconds,
+              result.allocations, result.bytes, result.iterations);
+}
+
+// collects every string constant, for the appendEscapedString phase
+class StringCollector : public Luau::AstVisitor {
+public:
+  std::vector<std::string_view> strings = {};
+
+  bool visit(Luau::AstExprConstantString *node) override {
+    strings.emplace_back(node->value.begin(), node->value.end());
+
+    return true;
+  }
+};
+
+static bool benchmarkFile(const std::filesystem::path &path,
+                          std::chrono::milliseconds minimumTime) {
+  std::optional<SourceFile> file = SourceFile::open(path.string());
+
+  if (!file.has_value()) {
+    std::fprintf(stderr, "failed to open %s\n", path.string().c_str());
+    return false;
+  }
+
+  const std::string_view source = file->text();
+  const size_t size = source.size() == 0 ? 1 : source.size();
+
+  Luau::Allocator allocator;
+  Luau::AstNameTable names(allocator);
+  Luau::ParseOptions options;
+  Luau::ParseResult parseResult = Luau::Parser::parse(
+      source.data(), source.size(), names, allocator, options);
+
+  if (!parseResult.errors.empty()) {
+    std::fprintf(stderr, "%s has parse errors, skipping\n",
+                 path.string().c_str());
+    return false;
+  }
+
+  Luau::AstStatBlock *root = parseResult.root;
+
+  AstTracking tracking;
+  tracking.foldConstants(root);
+  tracking.trackScopes(root);
+  root->visit(&tracking);
+
+  // handleNode only reads tracking and the glue, they can be shared by every
+  // run
+  Glue glue = initGlue(tracking);
+
+  StringCollector collector;
+  root->visit(&collector);
+
+  std::printf("%s (%zu bytes, %zu globals, %zu strings)\n",
+              path.filename().string().c_str(), source.size(),
+              tracking.globalUses.size(), tracking.stringUses.size());
+
+  report("parse", size, measure([&] {
+           Luau::Allocator parseAllocator;
+           Luau::AstNameTable parseNames(parseAllocator);
+
+           Luau::Parser::parse(source.data(), source.size(), parseNames,
+                               parseAllocator, options);
+         }, minimumTime));
+
+  report("AstTracking", size, measure([&] {
+           AstTracking phaseTracking;
+           phaseTracking.foldConstants(root);
+           phaseTracking.trackScopes(root);
+           root->visit(&phaseTracking);
+         }, minimumTime));
+
+  report("initGlue", size,
+         measure([&] { initGlue(tracking); }, minimumTime));
+
+  report("handleNode", size, measure([&] {
+           BlockInfo rootBlockInfo = {.parent = nullptr};
+           local_rename_map locals;
+           Output output;
+
+           State state = {.output = output,
+                          .totalLocals = glue.nameIndex,
+                          .glueNames = glue.nameIndex,
+                          .tracking = tracking,
+                          .globals = glue.globals,
+                          .strings = glue.strings,
+                          .blockInfo = &rootBlockInfo,
+                          .locals = locals};
+
+           handleNode(root, state);
+         }, minimumTime));
+
+  report("generateDot", size,
+         measure([&] { generateDot(root); }, minimumTime));
+
+  report("appendEscaped", size, measure([&] {
+           std::string output;
+
+           for (std::string_view string : collector.strings) {
+             appendEscapedString(output, string, '"');
+           }
+         }, minimumTime));
+
+  // as many names as the file's locals could need, at least a few thousand
+  const size_t nameCount = source.size() / 8 < 4096 ? 4096 : source.size() / 8;
+
+  report("getNameAtIndex", size, measure([&] {
+           for (size_t index = 1; index <= nameCount; index++) {
+             getNameAtIndex(index);
+           }
+         }, minimumTime));
+
+  return true;
+}
+
+static void displayHelp(const char *program) {
+  std::printf("usage: %s [--time <milliseconds>] [files...]\n"
+              "benchmarks every phase of the minifier on the given files, or "
+              "on the checked-in corpus (%s)\n",
+              program, MINIFIER_BENCH_CORPUS);
+}
+
+int main(int argc, char **argv) {
+  std::chrono::milliseconds minimumTime(250);
+  std::vector<std::filesystem::path> files;
+
+  for (int index = 1; index < argc; index++) {
+    const std::string_view argument = argv[index];
+
+    if (argument == "--help" || argument == "-h") {
+      displayHelp(argv[0]);
+      return 0;
+    } else if (argument == "--time" && index + 1 < argc) {
+      minimumTime = std::chrono::milliseconds(std::atol(argv[++index]));
+    } else {
+      files.emplace_back(argument);
+    }
+  }
+
+  if (files.empty()) {
+    std::error_code error;
+
+    for (const auto &entry :
+         std::filesystem::directory_iterator(MINIFIER_BENCH_CORPUS, error)) {
+      if (entry.is_regular_file()) {
+        files.push_back(entry.path());
+      }
+    }
+
+    // smallest file first
+    std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) {
+      return std::filesystem::file_size(a) < std::filesystem::file_size(b);
+    });
+  }
+
+  if (files.empty()) {
+    displayHelp(argv[0]);
+    return 1;
+  }
+
+  size_t failed = 0;
+
+  for (const std::filesystem::path &file : files) {
+    if (!benchmarkFile(file, minimumTime)) {
+      failed++;
+    }
+  }
+
+  return failed == 0 ? 0 : 1;
+}
@@ -7,7 +7,7 @@
 }:
 clangStdenv.mkDerivation {
   pname = "luau-minify";
-  version = "0.0.1";
+  version = "0.0.8";
 
   src = ./.;
 
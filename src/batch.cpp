@@ -0,0 +1,317 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "batch.h"
+#include "source.h"
+
+WorkStealingPool::WorkStealingPool(size_t workers)
+    : queues(std::max<size_t>(workers, 1)) {}
+
+bool WorkStealingPool::popLocal(size_t worker, size_t &job) {
+  Queue &queue = queues[worker];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+
+  if (queue.jobs.empty()) {
+    return false;
+  }
+
+  job = queue.jobs.back();
+  queue.jobs.pop_back();
+
+  return true;
+}
+
+bool WorkStealingPool::steal(size_t worker, size_t &job) {
+  // start at the next worker, so that thieves spread out over the victims
+  for (size_t offset = 1; offset < queues.size(); offset++) {
+    Queue &victim = queues[(worker + offset) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+
+    if (!victim.jobs.empty()) {
+      job = victim.jobs.front();
+      victim.jobs.pop_front();
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void WorkStealingPool::run(size_t jobs,
+                           const std::function<void(size_t, size_t)> &job) {
+  // deal the jobs out round-robin; stealing evens out any imbalance
+  for (size_t index = 0; index < jobs; index++) {
+    queues[index % queues.size()].jobs.emplace_back(index);
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(queues.size());
+
+  for (size_t worker = 0; worker < queues.size(); worker++) {
+    threads.emplace_back([this, worker, &job] {
+      size_t index;
+
+      while (popLocal(worker, index) || steal(worker, index)) {
+        job(index, worker);
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+static bool isLuauSource(const std::filesystem::path &path) {
+  return path.extension() == ".luau" || path.extension() == ".lua";
+}
+
+// strips root names and leading ".." components, so that the path can be
+// safely placed inside of the output directory
+static std::filesystem::path mirroredPath(const std::filesystem::path &path) {
+  std::filesystem::path mirrored;
+
+  for (const auto &component : path.lexically_normal().relative_path()) {
+    if (mirrored.empty() && component == "..") {
+      continue;
+    }
+
+    mirrored /= component;
+  }
+
+  return mirrored;
+}
+
+static bool collectInput(const std::filesystem::path &input,
+                         const BatchOptions &options,
+                         std::vector<BatchEntry> &entries) {
+  std::error_code error;
+
+  if (std::filesystem::is_directory(input, error)) {
+    for (const auto &file :
+         std::filesystem::recursive_directory_iterator(input, error)) {
+      if (file.is_regular_file() && isLuauSource(file.path())) {
+        entries.emplace_back(BatchEntry{
+            .input = file.path(),
+            .output = options.outputDirectory /
+                      file.path().lexically_relative(input),
+        });
+      }
+    }
+
+    return !error;
+  }
+
+  if (!std::filesystem::is_regular_file(input, error)) {
+    std::cerr << "failed reading file: " << input.string() << std::endl;
+    return false;
+  }
+
+  entries.emplace_back(BatchEntry{
+      .input = input,
+      .output = options.outputDirectory / mirroredPath(input),
+  });
+
+  return true;
+}
+
+bool collectBatchEntries(const std::vector<std::string> &inputs,
+                         const BatchOptions &options,
+                         std::vector<BatchEntry> &entries) {
+  bool success = true;
+
+  for (const auto &input : inputs) {
+    if (!input.starts_with("@")) {
+      success &= collectInput(input, options, entries);
+      continue;
+    }
+
+    // file list, one path per line
+    std::ifstream list{input.substr(1)};
+
+    if (!list.is_open()) {
+      std::cerr << "failed reading file list: " << input.substr(1)
+                << std::endl;
+      success = false;
+      continue;
+    }
+
+    std::string line;
+    while (std::getline(list, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+
+      if (!line.empty()) {
+        success &= collectInput(line, options, entries);
+      }
+    }
+  }
+
+  // directory iteration order is unspecified, keep diagnostics stable
+  std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) {
+    return a.input != b.input ? a.input < b.input : a.output < b.output;
+  });
+
+  // the same file collected twice (e.g. a directory given twice) is only
+  // processed once
+  entries.erase(std::unique(entries.begin(), entries.end(),
+                            [](const auto &a, const auto &b) {
+                              return a.input == b.input &&
+                                     a.output == b.output;
+                            }),
+                entries.end());
+
+  // different inputs mirrored to the same output (e.g. init.luau in two
+  // input directories) would overwrite each other, or share a bundle key.
+  // none of them are kept, which one won would be arbitrary
+  std::map<std::filesystem::path, size_t> outputs;
+  std::vector<bool> conflicting(entries.size(), false);
+
+  for (size_t index = 0; index < entries.size(); index++) {
+    const BatchEntry &entry = entries[index];
+    const auto [existing, inserted] =
+        outputs.try_emplace(entry.output.lexically_normal(), index);
+
+    if (!inserted) {
+      std::cerr << "both " << entries[existing->second].input.string()
+                << " and " << entry.input.string() << " would be written to "
+                << entry.output.string() << std::endl;
+
+      conflicting[existing->second] = true;
+      conflicting[index] = true;
+      success = false;
+    }
+  }
+
+  size_t kept = 0;
+
+  for (size_t index = 0; index < entries.size(); index++) {
+    if (!conflicting[index]) {
+      entries[kept++] = std::move(entries[index]);
+    }
+  }
+
+  entries.resize(kept);
+
+  return success;
+}
+
+size_t runBatch(const std::vector<BatchEntry> &entries,
+                const BatchOptions &options) {
+  size_t workers = options.workers;
+  if (workers == 0) {
+    workers = std::max<unsigned int>(std::thread::hardware_concurrency(), 1);
+  }
+
+  WorkStealingPool pool(std::min(workers, std::max<size_t>(entries.size(), 1)));
+
+  std::atomic<size_t> failures = 0;
+  std::mutex diagnosticsMutex;
+
+  pool.run(entries.size(), [&](size_t index, size_t) {
+    const BatchEntry &entry = entries[index];
+    std::string diagnostics;
+
+    std::optional<SourceFile> source = SourceFile::open(entry.input.string());
+
+    if (source == std::nullopt) {
+      diagnostics = "failed reading file: " + entry.input.string() + "\n";
+    } else {
+      PipelineResult result =
+          runPipeline(source->text(), options.mode, nullptr, options.cache);
+
+      if (!result.errors.empty()) {
+        diagnostics =
+            "Parse errors were encountered in " + entry.input.string() + ":\n";
+
+        for (const auto &error : result.errors) {
+          diagnostics.append(error);
+          diagnostics.append("\n");
+        }
+      } else {
+        std::error_code error;
+        std::filesystem::create_directories(entry.output.parent_path(), error);
+
+        std::ofstream file{entry.output,
+                           std::ios_base::binary | std::ios_base::trunc};
+
+        // same bytes as the single file path, which ends with std::endl
+        file << result.output << '\n';
+        file.close();
+
+        if (!file) {
+          diagnostics = "failed writing file: " + entry.output.string() + "\n";
+        }
+      }
+    }
+
+    if (!diagnostics.empty()) {
+      failures++;
+
+      std::lock_guard<std::mutex> lock(diagnosticsMutex);
+      std::cerr << diagnostics;
+    }
+  });
+
+  return failures;
+}
+
+bool runBundle(const std::vector<BatchEntry> &entries,
+               const std::filesystem::path &output) {
+  std::vector<SourceFile> files;
+  std::vector<BundleSource> sources;
+  files.reserve(entries.size());
+  sources.reserve(entries.size());
+
+  for (const BatchEntry &entry : entries) {
+    std::optional<SourceFile> source = SourceFile::open(entry.input.string());
+
+    if (source == std::nullopt) {
+      std::cerr << "failed reading file: " << entry.input.string()
+                << std::endl;
+      return false;
+    }
+
+    files.emplace_back(std::move(source.value()));
+    sources.emplace_back(BundleSource{
+        .name = std::filesystem::path(entry.output)
+                    .replace_extension()
+                    .generic_string(),
+        .text = files.back().text(),
+    });
+  }
+
+  PipelineResult result = runBundlePipeline(sources);
+
+  if (!result.errors.empty()) {
+    std::cerr << "Parse errors were encountered:" << std::endl;
+
+    for (const auto &error : result.errors) {
+      std::cerr << error << std::endl;
+    }
+
+    return false;
+  }
+
+  std::ofstream file{output, std::ios_base::binary | std::ios_base::trunc};
+
+  // same ending as the single file path
+  file << result.output << '\n';
+  file.close();
+
+  if (!file) {
+    std::cerr << "failed writing file: " << output.string() << std::endl;
+    return false;
+  }
+
+  return true;
+}
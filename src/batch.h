@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "driver.h"
+
+// Runs a fixed set of jobs across a number of worker threads. Every worker
+// owns a deque of job indices: it pops work from the back of its own deque,
+// and once that is empty it steals from the front of the other workers'
+// deques. Since no jobs are added after run() starts, a worker exits as soon
+// as every deque is empty.
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(size_t workers);
+
+  // calls job(jobIndex, workerIndex) for every index in [0, jobs), and blocks
+  // until all of them have finished
+  void run(size_t jobs, const std::function<void(size_t, size_t)> &job);
+
+  size_t workerCount() const { return queues.size(); }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> jobs = {};
+  };
+
+  std::vector<Queue> queues;
+
+  bool popLocal(size_t worker, size_t &job);
+  bool steal(size_t worker, size_t &job);
+};
+
+struct BatchEntry {
+  std::filesystem::path input;
+  std::filesystem::path output;
+};
+
+struct BatchOptions {
+  std::filesystem::path outputDirectory;
+  OutputMode mode = OutputMode::Minify;
+  size_t workers = 0; // 0 = std::thread::hardware_concurrency()
+  const ResultCache *cache = nullptr;
+};
+
+// Expands directories (recursively, *.lua and *.luau files) and file lists
+// ("@list.txt", one path per line) into entries whose outputs mirror the
+// input layout inside options.outputDirectory. Returns false if an input does
+// not exist, or if different inputs would be written to the same output (and
+// leaves all of those out).
+bool collectBatchEntries(const std::vector<std::string> &inputs,
+                         const BatchOptions &options,
+                         std::vector<BatchEntry> &entries);
+
+// Processes every entry on a WorkStealingPool, returns the number of failed
+// entries. Outputs are byte-identical to the single file path.
+size_t runBatch(const std::vector<BatchEntry> &entries,
+                const BatchOptions &options);
+
+// Minifies every entry into one bundle at output (see processBundle). Modules
+// are keyed by their entry's output path without the extension, e.g.
+// "Shared/Util" for src/Shared/Util.luau collected from src/. Returns false,
+// writing nothing, if any entry fails to read or parse.
+bool runBundle(const std::vector<BatchEntry> &entries,
+               const std::filesystem::path &output);
@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <chrono>
+
+#include "bundle.h"
+#include "syntax.h"
+#include "tracking.h"
+
+void processBundle(const std::vector<BundleModule> &modules, Output &output,
+                   MinifyStats *stats) {
+  using clock = std::chrono::steady_clock;
+  clock::time_point start;
+
+  if (stats != nullptr) {
+    start = clock::now();
+  }
+
+  // one analysis over every module, the hoisting decisions are made on the
+  // combined counts
+  AstTracking tracking;
+
+  for (const BundleModule &module : modules) {
+    tracking.foldConstants(module.root);
+    tracking.trackScopes(module.root);
+    module.root->visit(&tracking);
+  }
+
+  if (stats != nullptr) {
+    const clock::time_point now = clock::now();
+    stats->tracking = now - start;
+    start = now;
+  }
+
+  const Glue glue = initGlue(tracking);
+  output.append(glue.init);
+
+  if (stats != nullptr) {
+    const clock::time_point now = clock::now();
+    stats->glue = now - start;
+    start = now;
+  }
+
+  output.append("return{");
+
+  local_rename_map locals;
+  size_t highestLocal = glue.nameIndex;
+
+  for (size_t index = 0; index < modules.size(); index++) {
+    const BundleModule &module = modules[index];
+
+    output.append("[\"");
+    appendEscapedString(output, module.name, '"');
+    output.append("\"]=function(...)");
+
+    // a module's locals are only visible inside of its function
+    BlockInfo moduleBlockInfo = {.parent = nullptr};
+    locals.clear();
+
+    State state = {.output = output,
+                   .totalLocals = glue.nameIndex,
+                   .glueNames = glue.nameIndex,
+                   .tracking = tracking,
+                   .globals = glue.globals,
+                   .strings = glue.strings,
+                   .blockInfo = &moduleBlockInfo,
+                   .locals = locals};
+
+    handleNode(module.root, state);
+    highestLocal = std::max(highestLocal, state.highestLocal);
+
+    output.append("end");
+
+    if (index < modules.size() - 1) {
+      output.append(",");
+    }
+  }
+
+  output.append("}");
+
+  if (stats != nullptr) {
+    stats->emit = clock::now() - start;
+    stats->globals = glue.globals.size();
+    stats->strings = glue.hoistedStrings;
+    stats->locals = highestLocal - glue.nameIndex;
+    stats->removed = tracking.removedStatements();
+  }
+}
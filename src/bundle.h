@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Luau/Ast.h>
+#include <string>
+#include <vector>
+
+#include "minifier.h"
+#include "output.h"
+
+// One module of a bundle.
+struct BundleModule {
+  std::string name = ""; // key of the module's function in the bundle
+  Luau::AstStatBlock *root = nullptr;
+};
+
+// Minifies modules into a single chunk which returns their functions:
+//
+//   local <glue>;return{["name"]=function(...)<module>end,...}
+//
+// Globals and strings are counted over every module together, so the glue is
+// emitted once and every module closes over it. Modules can't see each
+// other's locals, so every module numbers its locals from the end of the
+// glue. Every root MUST be parsed with the same AstNameTable, globals are
+// matched by their interned names.
+void processBundle(const std::vector<BundleModule> &modules, Output &output,
+                   MinifyStats *stats = nullptr);
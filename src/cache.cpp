@@ -0,0 +1,60 @@
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <system_error>
+
+#include "cache.h"
+#include "sha256.h"
+
+#ifndef MINIFIER_VERSION
+#define MINIFIER_VERSION "unknown"
+#endif
+
+static std::string toHex(uint64_t value) {
+  char buffer[17];
+  snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)value);
+
+  return buffer;
+}
+
+std::string ResultCache::key(std::string_view source, OutputMode mode) const {
+  const std::string configuration = std::string(MINIFIER_VERSION) + "/" +
+                                    std::to_string(RESULT_CACHE_FORMAT) + "/" +
+                                    std::to_string((int)mode);
+
+  // the configuration can't contain a NUL, so it can't run into the source
+  Sha256 hash;
+  hash.update(configuration);
+  hash.update(std::string_view("\0", 1));
+  hash.update(source);
+
+  return hash.hex();
+}
+
+std::optional<SourceFile> ResultCache::lookup(const std::string &key) const {
+  return SourceFile::open((directory / key).string(), false);
+}
+
+void ResultCache::store(const std::string &key, std::string_view output) const {
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+
+  const std::filesystem::path target = directory / key;
+  const std::filesystem::path temporary =
+      directory / (key + ".tmp" + toHex(std::random_device()()));
+
+  std::ofstream file{temporary, std::ios_base::binary | std::ios_base::trunc};
+  file.write(output.data(), output.size());
+  file.close();
+
+  if (!file) {
+    std::filesystem::remove(temporary, error);
+    return;
+  }
+
+  std::filesystem::rename(temporary, target, error);
+
+  if (error) {
+    std::filesystem::remove(temporary, error);
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "driver.h"
+#include "source.h"
+
+// bump whenever the layout of cache entries changes
+static constexpr int RESULT_CACHE_FORMAT = 2;
+
+// On-disk cache of pipeline outputs, addressed by the contents of the input.
+// A key is the SHA-256 of the input bytes, the minifier version and the output
+// mode, so a hit can skip parsing, AstTracking, initGlue and handleNode
+// entirely. This relies on the output being deterministic for a given input
+// (see initGlue).
+class ResultCache {
+public:
+  explicit ResultCache(std::filesystem::path directory)
+      : directory(std::move(directory)) {}
+
+  std::string key(std::string_view source, OutputMode mode) const;
+
+  // the cached output, memory mapped
+  std::optional<SourceFile> lookup(const std::string &key) const;
+
+  // writes to a temporary file first and renames it into place, so that
+  // concurrent readers (batch workers, server threads) never see partial
+  // entries. failures are ignored, the cache is only an optimization
+  void store(const std::string &key, std::string_view output) const;
+
+private:
+  std::filesystem::path directory;
+};
@@ -0,0 +1,254 @@
+#include <ankerl/unordered_dense.h>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "compression.h"
+#include "syntax.h"
+
+static constexpr size_t WINDOW_SIZE = 32 * 1024;
+static constexpr size_t MIN_MATCH = 3;
+static constexpr size_t MAX_MATCH = 258;
+static constexpr size_t MAX_CHAIN = 64; // candidates tried per position
+
+static constexpr size_t HASH_BITS = 15;
+static constexpr uint32_t NO_POSITION = UINT32_MAX;
+
+// DEFLATE's alphabets: literals and end of block, then 29 length codes
+static constexpr size_t LITERAL_LENGTH_CODES = 257 + 29;
+static constexpr size_t DISTANCE_CODES = 30;
+
+static uint32_t hashAt(std::string_view text, size_t position) {
+  const uint32_t bytes = (uint8_t)text[position] |
+                         (uint8_t)text[position + 1] << 8 |
+                         (uint8_t)text[position + 2] << 16;
+
+  return (bytes * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// code and extra bits of a match length in [MIN_MATCH, MAX_MATCH]
+static void lengthCode(size_t length, size_t &code, size_t &extraBits) {
+  if (length == MAX_MATCH) {
+    code = 285;
+    extraBits = 0;
+    return;
+  }
+
+  const size_t value = length - MIN_MATCH;
+
+  if (value < 8) {
+    code = 257 + value;
+    extraBits = 0;
+    return;
+  }
+
+  const size_t bits = std::bit_width(value) - 1;
+  extraBits = bits - 2;
+  code = 257 + 4 * (bits - 1) + ((value >> extraBits) & 3);
+}
+
+// code and extra bits of a match distance in [1, WINDOW_SIZE]
+static void distanceCode(size_t distance, size_t &code, size_t &extraBits) {
+  const size_t value = distance - 1;
+
+  if (value < 4) {
+    code = value;
+    extraBits = 0;
+    return;
+  }
+
+  const size_t bits = std::bit_width(value) - 1;
+  extraBits = bits - 1;
+  code = 2 * bits + ((value >> extraBits) & 1);
+}
+
+// bits to code every symbol at its entropy
+static double entropyBits(const std::vector<size_t> &frequencies) {
+  size_t total = 0;
+  for (const size_t frequency : frequencies) {
+    total += frequency;
+  }
+
+  double bits = 0;
+  for (const size_t frequency : frequencies) {
+    if (frequency != 0) {
+      bits -= frequency * std::log2((double)frequency / total);
+    }
+  }
+
+  return bits;
+}
+
+size_t estimateCompressedSize(std::string_view text) {
+  std::vector<size_t> literalLengths(LITERAL_LENGTH_CODES);
+  std::vector<size_t> distances(DISTANCE_CODES);
+  size_t extraBits = 0;
+
+  std::vector<uint32_t> heads(size_t(1) << HASH_BITS, NO_POSITION);
+  std::vector<uint32_t> previous(WINDOW_SIZE, NO_POSITION);
+
+  const auto insert = [&](size_t position) {
+    if (position + MIN_MATCH <= text.size()) {
+      const uint32_t hash = hashAt(text, position);
+      previous[position % WINDOW_SIZE] = heads[hash];
+      heads[hash] = (uint32_t)position;
+    }
+  };
+
+  size_t position = 0;
+
+  while (position < text.size()) {
+    size_t bestLength = 0;
+    size_t bestDistance = 0;
+
+    if (position + MIN_MATCH <= text.size()) {
+      const size_t limit = std::min(MAX_MATCH, text.size() - position);
+      uint32_t candidate = heads[hashAt(text, position)];
+
+      for (size_t chain = 0; chain < MAX_CHAIN && candidate != NO_POSITION &&
+                             position - candidate <= WINDOW_SIZE;
+           chain++) {
+        size_t length = 0;
+        while (length < limit &&
+               text[candidate + length] == text[position + length]) {
+          length++;
+        }
+
+        if (length > bestLength) {
+          bestLength = length;
+          bestDistance = position - candidate;
+
+          if (length == limit) {
+            break;
+          }
+        }
+
+        candidate = previous[candidate % WINDOW_SIZE];
+      }
+    }
+
+    if (bestLength < MIN_MATCH) {
+      literalLengths[(uint8_t)text[position]]++;
+      insert(position);
+      position++;
+      continue;
+    }
+
+    size_t code, bits;
+
+    lengthCode(bestLength, code, bits);
+    literalLengths[code]++;
+    extraBits += bits;
+
+    distanceCode(bestDistance, code, bits);
+    distances[code]++;
+    extraBits += bits;
+
+    for (size_t index = 0; index < bestLength; index++) {
+      insert(position + index);
+    }
+
+    position += bestLength;
+  }
+
+  literalLengths[256]++; // end of block
+
+  const double bits =
+      entropyBits(literalLengths) + entropyBits(distances) + extraBits;
+
+  return (size_t)std::ceil(bits / 8);
+}
+
+// Whether one of the names given out (1 to highestName, glue and locals)
+// is also the name of a global, which only matters when globals keep their
+// names: the generated name would shadow the global.
+static bool shadowsGlobal(const AstTracking &tracking, size_t highestName) {
+  ankerl::unordered_dense::set<std::string_view> globals(
+      tracking.globalNames.begin(), tracking.globalNames.end());
+
+  for (size_t index = 1; index <= highestName; index++) {
+    if (globals.contains(getNameAtIndex(index).view())) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void processAstRootCompressed(Luau::AstStatBlock *root, Output &output,
+                              MinifyWorkspace &workspace, MinifyStats *stats,
+                              size_t workers) {
+  MinifyStats total = {};
+
+  // emits root with options, returning the text and its estimated size
+  const auto emit = [&](const EmitOptions &options, std::string &text,
+                        MinifyStats &runStats) {
+    Output buffer;
+    processAstRoot(root, buffer, workspace, &runStats, workers, options);
+    text = buffer.take();
+
+    total.tracking += runStats.tracking;
+    total.glue += runStats.glue;
+    total.emit += runStats.emit;
+
+    return estimateCompressedSize(text);
+  };
+
+  EmitOptions best = {};
+  std::string bestText;
+  MinifyStats bestStats = {};
+  size_t bestSize = emit(best, bestText, bestStats);
+
+  const size_t defaultRaw = bestText.size();
+  const size_t defaultCompressed = bestSize;
+
+  const std::function<void(EmitOptions &)> flips[] = {
+      [](EmitOptions &options) { options.glue.hoistStrings = false; },
+      [](EmitOptions &options) {
+        options.glue.globalOrder = GlobalOrder::FirstUse;
+      },
+      [](EmitOptions &options) { options.glue.aliasGlobals = false; },
+      [](EmitOptions &options) { options.compactFalse = false; },
+  };
+
+  for (const auto &flip : flips) {
+    EmitOptions candidate = best;
+    flip(candidate);
+
+    std::string text;
+    MinifyStats candidateStats = {};
+    const size_t size = emit(candidate, text, candidateStats);
+
+    if (!candidate.glue.aliasGlobals &&
+        shadowsGlobal(workspace.tracking, candidateStats.strings +
+                                              candidateStats.locals)) {
+      continue;
+    }
+
+    // on a tie, the smaller raw output wins
+    if (size < bestSize ||
+        (size == bestSize && text.size() < bestText.size())) {
+      best = candidate;
+      bestText = std::move(text);
+      bestStats = candidateStats;
+      bestSize = size;
+    }
+  }
+
+  output.append(bestText);
+
+  if (stats != nullptr) {
+    *stats = bestStats;
+    stats->tracking = total.tracking;
+    stats->glue = total.glue;
+    stats->emit = total.emit;
+
+    stats->compressed = bestSize;
+    stats->defaultRaw = defaultRaw;
+    stats->defaultCompressed = defaultCompressed;
+  }
+}
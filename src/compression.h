@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Luau/Ast.h>
+#include <cstddef>
+#include <string_view>
+
+#include "minifier.h"
+#include "output.h"
+
+// Roughly how many bytes DEFLATE (gzip -9) compresses text to, without
+// compressing it: a greedy LZ77 parse over a 32 KiB window, with every
+// literal, length and distance symbol costed at its entropy over the whole
+// text (as if a single dynamic Huffman block coded it) plus its extra bits.
+// Only meant for comparing outputs of the same source.
+size_t estimateCompressedSize(std::string_view text);
+
+// Like processAstRoot, but minimizes the estimated compressed size instead of
+// the raw size. Starting from EmitOptions' defaults, every option is flipped
+// in turn and the output is emitted again, keeping each flip that shrinks
+// it. The source is emitted once per option, plus once for the defaults.
+// Globals are only left unaliased if none of the generated names shadows one.
+void processAstRootCompressed(Luau::AstStatBlock *root, Output &output,
+                              MinifyWorkspace &workspace,
+                              MinifyStats *stats = nullptr,
+                              size_t workers = 1);
@@ -0,0 +1,350 @@
+#include <Luau/Ast.h>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string_view>
+#include <system_error>
+
+#include "constant.h"
+#include "syntax.h"
+
+// operands of % past this lose precision on the way, 2^53
+static constexpr double EXACT_INTEGER_LIMIT = 9007199254740992.0;
+
+bool Constant::isTruthy() const {
+  return type != Type::Nil && (type != Type::Boolean || boolean);
+}
+
+static Constant makeBoolean(bool value) {
+  return {.type = Constant::Type::Boolean, .boolean = value};
+}
+
+static Constant makeNumber(double value) {
+  return {.type = Constant::Type::Number, .number = value};
+}
+
+static bool isExactInteger(double value) {
+  return std::trunc(value) == value && std::fabs(value) < EXACT_INTEGER_LIMIT;
+}
+
+static bool equals(const Constant &left, const Constant &right) {
+  if (left.type != right.type) {
+    return false;
+  }
+
+  switch (left.type) {
+  case Constant::Type::Nil:
+    return true;
+  case Constant::Type::Boolean:
+    return left.boolean == right.boolean;
+  case Constant::Type::Number:
+    return left.number == right.number;
+  case Constant::Type::String:
+    return left.string == right.string;
+  }
+
+  return false;
+}
+
+std::optional<Constant> foldUnary(Luau::AstExprUnary::Op op,
+                                  const Constant &operand) {
+  switch (op) {
+  case Luau::AstExprUnary::Not:
+    return makeBoolean(!operand.isTruthy());
+  case Luau::AstExprUnary::Minus:
+    if (operand.type == Constant::Type::Number) {
+      return makeNumber(-operand.number);
+    }
+    break;
+  case Luau::AstExprUnary::Len:
+    if (operand.type == Constant::Type::String) {
+      return makeNumber((double)operand.string.size());
+    }
+    break;
+  }
+
+  return std::nullopt;
+}
+
+std::optional<Constant> foldBinary(Luau::AstExprBinary::Op op,
+                                   const Constant &left,
+                                   const Constant &right) {
+  using Op = Luau::AstExprBinary::Op;
+
+  switch (op) {
+  // never fail, whatever the operands are
+  case Op::CompareEq:
+    return makeBoolean(equals(left, right));
+  case Op::CompareNe:
+    return makeBoolean(!equals(left, right));
+  case Op::And:
+    return left.isTruthy() ? right : left;
+  case Op::Or:
+    return left.isTruthy() ? left : right;
+  // strings concatenate, numbers would be formatted by the VM
+  case Op::Concat:
+    if (left.type != Constant::Type::String ||
+        right.type != Constant::Type::String) {
+      return std::nullopt;
+    }
+    {
+      Constant result = {.type = Constant::Type::String};
+      result.string.reserve(left.string.size() + right.string.size());
+      result.string.append(left.string).append(right.string);
+      return result;
+    }
+  default:
+    break;
+  }
+
+  // the rest are arithmetic and ordering, strings would be coerced (or
+  // compared by the locale's collation)
+  if (left.type != Constant::Type::Number ||
+      right.type != Constant::Type::Number) {
+    return std::nullopt;
+  }
+
+  const double a = left.number;
+  const double b = right.number;
+
+  switch (op) {
+  case Op::Add:
+    return makeNumber(a + b);
+  case Op::Sub:
+    return makeNumber(a - b);
+  case Op::Mul:
+    return makeNumber(a * b);
+  case Op::Div:
+    return makeNumber(a / b);
+  case Op::FloorDiv:
+    return makeNumber(std::floor(a / b));
+  case Op::Pow:
+    return makeNumber(std::pow(a, b));
+  case Op::Mod:
+    // the VM's a - floor(a / b) * b (or fmod, in newer versions) round
+    // differently for fractions and huge operands, integers agree exactly
+    if (!isExactInteger(a) || !isExactInteger(b) || b == 0) {
+      return std::nullopt;
+    } else {
+      double result = std::fmod(a, b);
+      if (result != 0 && (result < 0) != (b < 0)) {
+        result += b;
+      }
+
+      // a zero from a negative dividend is -0 or 0 depending on which of
+      // the two the VM's version uses
+      if (result == 0 && std::signbit(a)) {
+        return std::nullopt;
+      }
+
+      return makeNumber(result == 0 ? 0 : result);
+    }
+  case Op::CompareLt:
+    return makeBoolean(a < b);
+  case Op::CompareLe:
+    return makeBoolean(a <= b);
+  case Op::CompareGt:
+    return makeBoolean(a > b);
+  case Op::CompareGe:
+    return makeBoolean(a >= b);
+  default:
+    return std::nullopt;
+  }
+}
+
+std::optional<Constant> literalConstant(const Luau::AstExpr *expr) {
+  if (expr->is<Luau::AstExprConstantNil>()) {
+    return Constant();
+  }
+
+  if (const auto boolean = expr->as<Luau::AstExprConstantBool>()) {
+    return makeBoolean(boolean->value);
+  }
+
+  if (const auto number = expr->as<Luau::AstExprConstantNumber>()) {
+    if (number->parseResult != Luau::ConstantNumberParseResult::Ok) {
+      return std::nullopt;
+    }
+
+    return makeNumber(number->value);
+  }
+
+  if (const auto string = expr->as<Luau::AstExprConstantString>()) {
+    return Constant{.type = Constant::Type::String,
+                    .string = std::string(string->value.begin(),
+                                          string->value.end())};
+  }
+
+  return std::nullopt;
+}
+
+std::optional<Constant> evaluateConstant(const Luau::AstExpr *expr) {
+  if (const auto group = expr->as<Luau::AstExprGroup>()) {
+    return evaluateConstant(group->expr);
+  }
+
+  if (const auto unary = expr->as<Luau::AstExprUnary>()) {
+    const auto operand = evaluateConstant(unary->expr);
+    return operand ? foldUnary(unary->op, *operand) : std::nullopt;
+  }
+
+  if (const auto binary = expr->as<Luau::AstExprBinary>()) {
+    const auto left = evaluateConstant(binary->left);
+    if (!left) {
+      return std::nullopt;
+    }
+
+    const auto right = evaluateConstant(binary->right);
+    return right ? foldBinary(binary->op, *left, *right) : std::nullopt;
+  }
+
+  return literalConstant(expr);
+}
+
+// the shortest digits which read back as value, the way the minifier writes
+// number literals
+static std::string formatNumber(double value) {
+  char buffer[std::numeric_limits<double>::max_digits10 + 8];
+
+  const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  if (result.ec != std::errc()) {
+    return "";
+  }
+
+  return std::string(buffer, result.ptr);
+}
+
+std::optional<std::string> formatConstant(const Constant &constant) {
+  switch (constant.type) {
+  case Constant::Type::Nil:
+    return "nil";
+  case Constant::Type::Boolean:
+    return constant.boolean ? "true" : "false";
+  case Constant::Type::Number: {
+    if (!std::isfinite(constant.number)) {
+      return std::nullopt;
+    }
+
+    const std::string digits = formatNumber(constant.number);
+    if (digits.empty()) {
+      return std::nullopt;
+    }
+
+    // -0 too, as the sign of a zero shows through division
+    if (std::signbit(constant.number)) {
+      return "(" + digits + ")";
+    }
+
+    return digits;
+  }
+  case Constant::Type::String: {
+    std::string literal = "\"";
+    appendEscapedString(literal, constant.string, '"');
+    literal.append("\"");
+    return literal;
+  }
+  }
+
+  return std::nullopt;
+}
+
+// Walks the tree for operators, folding each one it reaches together with
+// every operator under it, innermost first. Lengths are measured the way the
+// minifier writes literals and operators, ignoring hoisted strings and
+// renamed globals.
+class ConstantFolder : public Luau::AstVisitor {
+public:
+  explicit ConstantFolder(constant_folds &folds) : folds(folds) {}
+
+  bool visit(Luau::AstExprUnary *node) override {
+    fold(node);
+    return false;
+  }
+
+  bool visit(Luau::AstExprBinary *node) override {
+    fold(node);
+    return false;
+  }
+
+  // only the inside, the parentheses can be needed around the result
+  bool visit(Luau::AstExprGroup *node) override {
+    fold(node->expr);
+    return false;
+  }
+
+private:
+  // value is nullopt when the expression isn't constant
+  struct Folded {
+    std::optional<Constant> value = std::nullopt;
+    size_t length = 0; // written out, or as its fold
+  };
+
+  constant_folds &folds;
+
+  Folded fold(Luau::AstExpr *expr) {
+    if (const auto group = expr->as<Luau::AstExprGroup>()) {
+      Folded folded = fold(group->expr);
+      folded.length += 2;
+      return settle(expr, std::move(folded));
+    }
+
+    if (const auto unary = expr->as<Luau::AstExprUnary>()) {
+      Folded operand = fold(unary->expr);
+      Folded folded = {
+          .length = std::strlen(unarySymbol(unary->op)) + operand.length};
+
+      if (operand.value) {
+        folded.value = foldUnary(unary->op, *operand.value);
+      }
+
+      return settle(expr, std::move(folded));
+    }
+
+    if (const auto binary = expr->as<Luau::AstExprBinary>()) {
+      Folded left = fold(binary->left);
+      Folded right = fold(binary->right);
+      Folded folded = {.length = left.length +
+                                 std::strlen(compoundSymbols[binary->op]) +
+                                 right.length};
+
+      if (left.value && right.value) {
+        folded.value = foldBinary(binary->op, *left.value, *right.value);
+      }
+
+      return settle(expr, std::move(folded));
+    }
+
+    if (auto literal = literalConstant(expr)) {
+      const auto text = formatConstant(*literal);
+      return {.value = std::move(literal), .length = text ? text->size() : 0};
+    }
+
+    // anything else can still have operators under it
+    expr->visit(this);
+    return {};
+  }
+
+  // records expr's fold when its literal is shorter than expr written out
+  Folded settle(Luau::AstExpr *expr, Folded folded) {
+    if (!folded.value) {
+      return folded;
+    }
+
+    // NaN and the infinities are only written as operators, but can still
+    // fold into a parent (1/0>0)
+    const auto literal = formatConstant(*folded.value);
+    if (!literal || literal->size() >= folded.length) {
+      return folded;
+    }
+
+    folds[expr] = *literal;
+    folded.length = literal->size();
+    return folded;
+  }
+};
+
+void findConstantFolds(Luau::AstNode *node, constant_folds &folds) {
+  ConstantFolder folder(folds);
+  node->visit(&folder);
+}
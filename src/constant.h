@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Luau/Ast.h>
+#include <ankerl/unordered_dense.h>
+#include <cstddef>
+#include <optional>
+#include <string>
+
+// A value known before the code runs, see evaluateConstant
+struct Constant {
+  enum class Type {
+    Nil = 0,
+    Boolean,
+    Number,
+    String,
+  };
+
+  Type type = Type::Nil;
+  bool boolean = false;
+  double number = 0;
+  std::string string = "";
+
+  bool isTruthy() const;
+};
+
+// What Luau evaluates an operator to on constant operands, with the VM's
+// (and the Luau compiler's own folding's) semantics. nullopt when that isn't
+// known up front: the operation would fail or call a metamethod, coerces a
+// string to a number (or back), or depends on the locale (string ordering).
+std::optional<Constant> foldUnary(Luau::AstExprUnary::Op op,
+                                  const Constant &operand);
+std::optional<Constant> foldBinary(Luau::AstExprBinary::Op op,
+                                   const Constant &left,
+                                   const Constant &right);
+
+// The value of a nil, boolean, number or string literal, nullopt for any
+// other expression (and for numbers which didn't parse exactly)
+std::optional<Constant> literalConstant(const Luau::AstExpr *expr);
+
+// The value of expr if it is made only of literals, parentheses and
+// operators which fold
+std::optional<Constant> evaluateConstant(const Luau::AstExpr *expr);
+
+// The shortest source for constant which can stand in for an operand of any
+// operator: negative numbers are parenthesized and false is written out.
+// nullopt for NaN and the infinities, which have no literal.
+std::optional<std::string> formatConstant(const Constant &constant);
+
+// constant expressions, and the literal they are written as instead
+typedef ankerl::unordered_dense::map<const Luau::AstExpr *, std::string>
+    constant_folds;
+
+// Finds the constant expressions under node whose value is shorter than the
+// way they are written. An expression which folds is written as its literal,
+// so the folds recorded inside of it go unused. Parentheses which aren't an
+// operand stay, as they can be a prefix (("a"):rep(2)).
+void findConstantFolds(Luau::AstNode *node, constant_folds &folds);
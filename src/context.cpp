@@ -0,0 +1,103 @@
+#include <Luau/ParseOptions.h>
+#include <Luau/Parser.h>
+#include <chrono>
+#include <string_view>
+#include <utility>
+
+#include "compression.h"
+#include "context.h"
+#include "minifier.h"
+#include "tracking.h"
+
+void Minifier::prepareArena(size_t sourceSize) {
+  arenaSource += sourceSize;
+
+  if (allocator.has_value() && arenaSource <= ARENA_RESET_SOURCE) {
+    return;
+  }
+
+  names.reset();
+  allocator.reset();
+  arena.reset();
+
+  arena.emplace(MemorySubsystem::LuauArena);
+  allocator.emplace();
+  arena->track([&] { names.emplace(*allocator); });
+
+  arenaSource = sourceSize;
+}
+
+const Minifier::Result &Minifier::minify(std::string_view source,
+                                         const Options &options) {
+  using clock = std::chrono::steady_clock;
+
+  PipelineStats *stats = options.stats;
+  clock::time_point start;
+
+  result.output = {};
+  result.errors.clear();
+
+  prepareArena(source.size());
+
+  if (stats != nullptr) {
+    stats->bytesIn = source.size();
+    start = clock::now();
+  }
+
+  Luau::ParseResult parseResult;
+
+  arena->track([&] {
+    parseResult = Luau::Parser::parse(source.data(), source.size(), *names,
+                                      *allocator, options.parseOptions);
+  });
+
+  if (stats != nullptr) {
+    stats->parse = clock::now() - start;
+  }
+
+  if (!parseResult.errors.empty()) {
+    result.errors = std::move(parseResult.errors);
+    return result;
+  }
+
+  output.reset(options.sink);
+
+  if (options.mode == OutputMode::Minify) {
+    // minified code is hardly ever longer than its source
+    if (options.sink == nullptr) {
+      output.reserve(source.size());
+    }
+
+    processAstRoot(parseResult.root, output, workspace,
+                   stats != nullptr ? &stats->minify : nullptr,
+                   options.workers);
+  } else if (options.mode == OutputMode::MinifyCompressed) {
+    processAstRootCompressed(parseResult.root, output, workspace,
+                             stats != nullptr ? &stats->minify : nullptr,
+                             options.workers);
+  } else {
+    if (stats != nullptr) {
+      start = clock::now();
+    }
+
+    output.append(generateDot(parseResult.root));
+
+    if (stats != nullptr) {
+      stats->dot = clock::now() - start;
+    }
+  }
+
+  if (stats != nullptr) {
+    stats->bytesOut = output.size();
+
+    if (options.mode != OutputMode::Dotviz) {
+      stats->minify.removedBytes =
+          workspace.tracking.removedSourceBytes(parseResult.root, source);
+    }
+  }
+
+  output.flush();
+  result.output = output.pending();
+
+  return result;
+}
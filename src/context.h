@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Luau/Ast.h>
+#include <Luau/ParseOptions.h>
+#include <Luau/Parser.h>
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "memory.h"
+#include "minifier.h"
+#include "output.h"
+
+// What the pipeline should produce from a parsed source
+enum class OutputMode {
+  Minify = 0,
+  Dotviz,
+  MinifyCompressed, // smallest compressed size, see processAstRootCompressed
+};
+
+// Filled in by the pipeline when requested; phases which did not run (all of
+// them on cache hits) are left at zero.
+struct PipelineStats {
+  size_t bytesIn = 0;
+  size_t bytesOut = 0;
+  bool cacheHit = false;
+
+  std::chrono::nanoseconds parse = {};
+  std::chrono::nanoseconds dot = {}; // generateDot, in OutputMode::Dotviz
+  MinifyStats minify = {};
+};
+
+/*
+  Parses and minifies sources, for hosts which process many of them in one
+  process (the CLI keeps one per thread). The name table, the hash maps of
+  AstTracking and the glue, and the output buffer are reused between calls
+  and cleared instead of freed.
+
+  Luau::Allocator cannot be reset, so the arena keeps every parse tree until
+  ARENA_RESET_SOURCE bytes of source went through it; it is recreated (along
+  with the name table, which lives in it) after that.
+*/
+class Minifier {
+public:
+  static constexpr size_t ARENA_RESET_SOURCE = 1024 * 1024;
+
+  struct Options {
+    OutputMode mode = OutputMode::Minify;
+    OutputSink *sink = nullptr; // receives the output instead of Result
+    PipelineStats *stats = nullptr;
+    Luau::ParseOptions parseOptions = {};
+    size_t workers = 1; // threads emitting the output, see processAstRoot
+  };
+
+  struct Result {
+    // valid until the next minify call, empty when the output went to a sink
+    std::string_view output = {};
+    std::vector<Luau::ParseError> errors = {};
+
+    bool ok() const { return errors.empty(); }
+  };
+
+  Minifier() = default;
+  Minifier(const Minifier &) = delete;
+  Minifier &operator=(const Minifier &) = delete;
+
+  // Nothing is written to a sink if parsing fails.
+  const Result &minify(std::string_view source, const Options &options);
+  const Result &minify(std::string_view source) {
+    return minify(source, Options());
+  }
+
+private:
+  // declared in destruction order: the name table lives in the allocator
+  std::optional<MemoryScope> arena;
+  std::optional<Luau::Allocator> allocator;
+  std::optional<Luau::AstNameTable> names;
+  size_t arenaSource = 0;
+
+  MinifyWorkspace workspace;
+  Output output;
+  Result result;
+
+  void prepareArena(size_t sourceSize);
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Luau/Ast.h>
+#include <cstddef>
+#include <vector>
+
+// Jump table from Luau's AST class indices (AstNode::classIndex) to handlers,
+// so that dispatching on a node costs one indirect call instead of a chain of
+// is<...>() checks. Nodes without a handler are ignored.
+//
+// Luau numbers its node classes while running static initializers, so tables
+// MUST be built on first use (e.g. as a function-local static), not as globals.
+template <typename State> class NodeDispatch {
+public:
+  typedef void (*Handler)(const Luau::AstNode *node, State &state);
+
+  template <typename T, void (*handler)(const T *, State &)>
+  NodeDispatch &on() {
+    const size_t index = static_cast<size_t>(T::ClassIndex());
+
+    if (index >= handlers.size()) {
+      handlers.resize(index + 1, nullptr);
+    }
+
+    handlers[index] = &call<T, handler>;
+
+    return *this;
+  }
+
+  void operator()(const Luau::AstNode *node, State &state) const {
+    const size_t index = static_cast<size_t>(node->classIndex);
+
+    if (index < handlers.size() && handlers[index] != nullptr) {
+      handlers[index](node, state);
+    }
+  }
+
+private:
+  std::vector<Handler> handlers = {};
+
+  template <typename T, void (*handler)(const T *, State &)>
+  static void call(const Luau::AstNode *node, State &state) {
+    handler(static_cast<const T *>(node), state);
+  }
+};
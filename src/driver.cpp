@@ -0,0 +1,214 @@
+#include <Luau/ParseOptions.h>
+#include <Luau/Parser.h>
+#include <chrono>
+#include <sstream>
+#include <string>
+
+#include "bundle.h"
+#include "cache.h"
+#include "context.h"
+#include "driver.h"
+#include "incremental.h"
+#include "memory.h"
+
+std::string formatLocation(const Luau::Location &location) {
+  std::ostringstream out;
+
+  Luau::Position begin = location.begin;
+  Luau::Position end = location.end;
+
+  out << begin.line << ":" << begin.column << " - " << end.line << ":"
+      << end.column;
+
+  return out.str();
+}
+
+static void appendErrors(const std::vector<Luau::ParseError> &errors,
+                         PipelineResult &result) {
+  for (const Luau::ParseError &error : errors) {
+    result.errors.emplace_back("  " + formatLocation(error.getLocation()) +
+                               " - " + error.getMessage());
+  }
+}
+
+// parses source into parseResult, returns false (and fills result.errors) on
+// parse errors. allocations made while parsing are attributed to arena
+static bool parseSource(std::string_view source, Luau::AstNameTable &names,
+                        Luau::Allocator &allocator, MemoryScope &arena,
+                        Luau::ParseResult &parseResult, PipelineResult &result,
+                        PipelineStats *stats) {
+  Luau::ParseOptions options;
+  std::chrono::steady_clock::time_point start;
+
+  if (stats != nullptr) {
+    stats->bytesIn = source.size();
+    start = std::chrono::steady_clock::now();
+  }
+
+  arena.track([&] {
+    parseResult = Luau::Parser::parse(source.data(), source.size(), names,
+                                      allocator, options);
+  });
+
+  if (stats != nullptr) {
+    stats->parse = std::chrono::steady_clock::now() - start;
+  }
+
+  appendErrors(parseResult.errors, result);
+
+  return parseResult.errors.empty();
+}
+
+// every thread (the main thread, batch workers, server connections) minifies
+// with its own context
+static thread_local Minifier threadMinifier;
+
+PipelineResult runPipeline(std::string_view source, OutputMode mode,
+                           OutputSink *sink, const ResultCache *cache,
+                           PipelineStats *stats, size_t workers) {
+  PipelineResult result = {};
+  std::string cacheKey;
+
+  if (cache != nullptr) {
+    cacheKey = cache->key(source, mode);
+
+    if (std::optional<SourceFile> cached = cache->lookup(cacheKey)) {
+      Output output(sink);
+      output.append(cached->text());
+
+      if (stats != nullptr) {
+        stats->bytesIn = source.size();
+        stats->bytesOut = output.size();
+        stats->cacheHit = true;
+      }
+
+      output.flush();
+      result.output = output.take();
+
+      return result;
+    }
+  }
+
+  // cache misses are buffered whole, so that they can be stored afterwards
+  Minifier::Options options = {
+      .mode = mode,
+      .sink = cache == nullptr ? sink : nullptr,
+      .stats = stats,
+      .workers = workers,
+  };
+
+  const Minifier::Result &minified = threadMinifier.minify(source, options);
+
+  if (!minified.ok()) {
+    appendErrors(minified.errors, result);
+    return result;
+  }
+
+  if (cache != nullptr) {
+    cache->store(cacheKey, minified.output);
+
+    if (sink != nullptr) {
+      sink->write(minified.output);
+      return result;
+    }
+  }
+
+  result.output = minified.output;
+
+  return result;
+}
+
+PipelineResult runIncrementalPipeline(std::string_view source,
+                                      const std::string &statePath,
+                                      OutputSink *sink,
+                                      IncrementalStats *stats,
+                                      PipelineStats *pipelineStats) {
+  PipelineResult result = {};
+
+  MemoryScope arena(MemorySubsystem::LuauArena);
+  Luau::Allocator allocator;
+  Luau::AstNameTable names(allocator);
+  Luau::ParseResult parseResult;
+
+  if (!parseSource(source, names, allocator, arena, parseResult, result,
+                   pipelineStats)) {
+    return result;
+  }
+
+  // a missing or unreadable state is a first run
+  IncrementalState state;
+  loadIncrementalState(statePath, state);
+
+  Output output(sink);
+  processAstRootIncremental(parseResult.root, source, names, state, output,
+                            stats);
+
+  if (pipelineStats != nullptr) {
+    pipelineStats->bytesOut = output.size();
+  }
+
+  output.flush();
+  result.output = output.take();
+
+  saveIncrementalState(statePath, state);
+
+  return result;
+}
+
+PipelineResult runBundlePipeline(const std::vector<BundleSource> &sources,
+                                 OutputSink *sink, PipelineStats *stats) {
+  PipelineResult result = {};
+
+  // globals are matched across modules by their interned names, so every
+  // module goes into the same name table
+  MemoryScope arena(MemorySubsystem::LuauArena);
+  Luau::Allocator allocator;
+  Luau::AstNameTable names(allocator);
+
+  std::vector<BundleModule> modules;
+  modules.reserve(sources.size());
+
+  std::chrono::nanoseconds parseTime = {};
+  size_t bytesIn = 0;
+
+  for (const BundleSource &source : sources) {
+    Luau::ParseResult parseResult;
+    PipelineResult moduleResult;
+    PipelineStats moduleStats;
+
+    if (!parseSource(source.text, names, allocator, arena, parseResult,
+                     moduleResult, &moduleStats)) {
+      for (const std::string &error : moduleResult.errors) {
+        result.errors.emplace_back("  " + source.name + ":" + error.substr(1));
+      }
+    }
+
+    parseTime += moduleStats.parse;
+    bytesIn += moduleStats.bytesIn;
+
+    modules.emplace_back(BundleModule{.name = source.name,
+                                      .root = parseResult.root});
+  }
+
+  if (stats != nullptr) {
+    stats->bytesIn = bytesIn;
+    stats->parse = parseTime;
+  }
+
+  if (!result.errors.empty()) {
+    return result;
+  }
+
+  Output output(sink);
+  processBundle(modules, output,
+                stats != nullptr ? &stats->minify : nullptr);
+
+  if (stats != nullptr) {
+    stats->bytesOut = output.size();
+  }
+
+  output.flush();
+  result.output = output.take();
+
+  return result;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Luau/Location.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "context.h"
+#include "incremental.h"
+#include "output.h"
+
+class ResultCache;
+
+struct PipelineResult {
+  std::string output = ""; // empty when the output went to a sink
+
+  // formatted "  <location> - <message>" lines, empty when parsing succeeded
+  std::vector<std::string> errors = {};
+};
+
+std::string formatLocation(const Luau::Location &location);
+
+// Parses and processes source with the calling thread's Minifier, so batch
+// workers and server threads reuse their arena, maps and buffers. When a
+// sink is given, the output is streamed into it (and flushed) instead of
+// being returned; nothing is written to it if parsing fails. With a cache,
+// hits skip the whole pipeline, and misses are stored once they succeed.
+// workers > 1 emits large sources on that many threads.
+PipelineResult runPipeline(std::string_view source, OutputMode mode,
+                           OutputSink *sink = nullptr,
+                           const ResultCache *cache = nullptr,
+                           PipelineStats *stats = nullptr, size_t workers = 1);
+
+// Like runPipeline in OutputMode::Minify, but only re-emits the top-level
+// statements which changed since the run recorded at statePath, and then
+// records this run there.
+PipelineResult runIncrementalPipeline(std::string_view source,
+                                      const std::string &statePath,
+                                      OutputSink *sink = nullptr,
+                                      IncrementalStats *stats = nullptr,
+                                      PipelineStats *pipelineStats = nullptr);
+
+struct BundleSource {
+  std::string name = ""; // the module's key in the bundle
+  std::string_view text = {};
+};
+
+// Parses every source and minifies them together with processBundle. Parse
+// errors are prefixed with their module's name; nothing is emitted unless
+// every module parses.
+PipelineResult runBundlePipeline(const std::vector<BundleSource> &sources,
+                                 OutputSink *sink = nullptr,
+                                 PipelineStats *stats = nullptr);
@@ -0,0 +1,65 @@
+#include <Luau/Common.h>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "../memory.h"
+#include "arena.hpp"
+
+static thread_local GraphArena *currentArena = nullptr;
+
+GraphArena::~GraphArena() {
+  while (pages != nullptr) {
+    Page *next = pages->next;
+
+    recordRelease(MemorySubsystem::Graph, pages->size);
+    ::operator delete(pages);
+
+    pages = next;
+  }
+}
+
+void GraphArena::addPage(size_t minimumSize) {
+  const size_t size =
+      sizeof(Page) + (minimumSize > PAGE_SIZE ? minimumSize : PAGE_SIZE);
+
+  Page *page = static_cast<Page *>(::operator new(size));
+  page->next = pages;
+  page->size = size;
+
+  pages = page;
+  cursor = reinterpret_cast<char *>(page + 1);
+  end = reinterpret_cast<char *>(page) + size;
+  reserved += size;
+
+  recordAllocation(MemorySubsystem::Graph, size);
+}
+
+void *GraphArena::allocate(size_t size, size_t alignment) {
+  uintptr_t aligned =
+      (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+
+  if (cursor == nullptr || aligned + size > reinterpret_cast<uintptr_t>(end)) {
+    // room for the worst case alignment padding
+    addPage(size + alignment);
+
+    aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) &
+              ~(alignment - 1);
+  }
+
+  cursor = reinterpret_cast<char *>(aligned + size);
+
+  return reinterpret_cast<void *>(aligned);
+}
+
+GraphArena &GraphArena::current() {
+  LUAU_ASSERT(currentArena != nullptr);
+
+  return *currentArena;
+}
+
+GraphArena::Scope::Scope(GraphArena &arena) : previous(currentArena) {
+  currentArena = &arena;
+}
+
+GraphArena::Scope::~Scope() { currentArena = previous; }
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <ankerl/unordered_dense.h>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Bump allocator the dependency graph lives in. Blocks, statements and their
+// containers all allocate from the arena of the active GraphArena::Scope, and
+// are never destroyed one by one: the arena frees its pages in one go.
+class GraphArena {
+public:
+  static constexpr size_t PAGE_SIZE = 64 * 1024;
+
+  GraphArena() = default;
+  GraphArena(const GraphArena &) = delete;
+  GraphArena &operator=(const GraphArena &) = delete;
+  ~GraphArena();
+
+  void *allocate(size_t size, size_t alignment);
+
+  // bytes held in pages
+  size_t size() const { return reserved; }
+
+  // the arena graph allocations on this thread go to, MUST be in a Scope
+  static GraphArena &current();
+
+  // makes arena the current one for its lifetime
+  class Scope {
+  public:
+    explicit Scope(GraphArena &arena);
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    ~Scope();
+
+  private:
+    GraphArena *previous;
+  };
+
+private:
+  struct Page {
+    Page *next;
+    size_t size;
+  };
+
+  Page *pages = nullptr;
+  char *cursor = nullptr;
+  char *end = nullptr;
+  size_t reserved = 0;
+
+  void addPage(size_t minimumSize);
+};
+
+// Standard allocator for containers inside graph nodes; deallocating is a
+// no-op, the memory is returned with the arena.
+template <typename T> struct GraphAllocator {
+  using value_type = T;
+
+  GraphAllocator() noexcept = default;
+
+  template <typename U> GraphAllocator(const GraphAllocator<U> &) noexcept {}
+
+  T *allocate(size_t count) {
+    return static_cast<T *>(
+        GraphArena::current().allocate(count * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T *, size_t) noexcept {}
+
+  template <typename U> bool operator==(const GraphAllocator<U> &) const {
+    return true;
+  }
+
+  template <typename U> bool operator!=(const GraphAllocator<U> &) const {
+    return false;
+  }
+};
+
+template <typename T> using graph_vector = std::vector<T, GraphAllocator<T>>;
+
+template <typename K, typename V>
+using graph_map =
+    ankerl::unordered_dense::map<K, V, ankerl::unordered_dense::hash<K>,
+                                 std::equal_to<K>,
+                                 GraphAllocator<std::pair<K, V>>>;
+
+// Graph nodes derive from this, so that `new` places them in the current arena.
+// They are never deleted.
+struct GraphNode {
+  static void *operator new(size_t size) {
+    return GraphArena::current().allocate(size, alignof(std::max_align_t));
+  }
+
+  // only called if a constructor throws, the memory stays in the arena
+  static void operator delete(void *) {}
+};
@@ -5,6 +5,7 @@
 #include <cstddef>
 #include <vector>
 
+#include "arena.hpp"
 #include "rtti.hpp"
 #include "statement.hpp"
 
@@ -20,10 +21,11 @@ enum class Type {
 
 struct LocalInfo {
   size_t uses = 0;
-  std::vector<Type> types = {};
+  graph_vector<Type> types = {};
 };
 
-class Block {
+// Allocated in the current GraphArena (see GraphNode), destructors never run.
+class Block : public GraphNode {
 public:
   const int classIndex;
 
@@ -31,28 +33,14 @@ public:
       : classIndex(classIndex), parent(parent) {}
   explicit Block(int classIndex) : classIndex(classIndex) {}
 
-  ankerl::unordered_dense::map<const char *, LocalInfo> locals = {};
-  ankerl::unordered_dense::map<const char *, Block *> dependencies = {};
-  std::vector<Statement *> statements = {};
-  std::vector<Block *> children = {};
-  std::vector<bool> order = {}; // 1 = statement, 0 = child (read order)
+  graph_map<const char *, LocalInfo> locals = {};
+  graph_map<const char *, Block *> dependencies = {};
+  graph_vector<Statement *> statements = {};
+  graph_vector<Block *> children = {};
+  graph_vector<bool> order = {}; // 1 = statement, 0 = child (read order)
 
   Block *parent = nullptr;
 
-  virtual ~Block() {
-    for (auto *statement : statements) {
-      delete statement;
-    }
-
-    statements.clear();
-
-    for (auto *child : children) {
-      delete child;
-    }
-
-    children.clear();
-  };
-
   inline const void pushStatement(Statement *s) {
     statements.emplace_back(s);
     order.emplace_back(1);
@@ -160,28 +148,6 @@ public:
   RTTI(IfStatementBlock)
 
   explicit IfStatementBlock();
-  ~IfStatementBlock() {
-    // no double free's! hash_sets can only hold one version of one value at
-    // once
-    ankerl::unordered_dense::set<Block *> targets;
-    targets.insert(thenBody);
-    targets.insert(elseBody);
-
-    for (const auto [ptr, _] : elseifs) {
-      targets.insert(ptr);
-    };
-
-    for (const auto ptr : children) {
-      targets.insert(ptr);
-    }
-
-    for (const auto ptr : targets) {
-      delete ptr;
-    }
-
-    elseifs.clear();
-    children.clear();
-  }
 
   // root condition
   Luau::AstExpr *condition;
@@ -189,7 +155,7 @@ public:
   Block *elseBody;
 
   // else if condition is in pair->second
-  std::vector<std::pair<Block *, Luau::AstExpr *>> elseifs;
+  graph_vector<std::pair<Block *, Luau::AstExpr *>> elseifs;
 };
 
 class IfBlock : public Block {
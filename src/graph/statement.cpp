@@ -1,3 +1,7 @@
+#include <optional>
+#include <string_view>
+
+#include "../constant.h"
 #include "statement.hpp"
 
 LocalAssignStatement::LocalAssignStatement()
@@ -21,6 +25,30 @@ ContinueStatement::ContinueStatement()
 ExpressionStatement::ExpressionStatement()
     : Statement(ExpressionStatement::ClassIndex()), value(nullptr) {}
 
+// The value of a constant expression, escaped for a record label, or
+// [expression] for anything else
+static std::string describeValue(const Luau::AstExpr *value) {
+  const auto constant = evaluateConstant(value);
+  const auto literal =
+      constant ? formatConstant(*constant) : std::optional<std::string>();
+
+  if (!literal) {
+    return "[expression]";
+  }
+
+  std::string escaped = "";
+  for (const char character : *literal) {
+    if (std::string_view("\\\"|{}<>").find(character) !=
+        std::string_view::npos) {
+      escaped += '\\';
+    }
+
+    escaped += character;
+  }
+
+  return escaped;
+}
+
 const std::vector<std::string> getFields(Statement *statement) {
   std::vector<std::string> fields = {};
 
@@ -28,14 +56,13 @@ const std::vector<std::string> getFields(Statement *statement) {
     for (size_t index = 0; index < locals->vars.size(); index++) {
       std::string str = "";
       str.append(locals->vars[index]->name.value);
-      str.append(" = [expression]"); // TODO: display this when we get an
-                                     // expression engine
+      str.append(" = ");
+      str.append(describeValue(locals->values[index]));
       fields.emplace_back(str);
     }
   } else if (auto assign = statement->as<AssignStatement>()) {
     for (size_t index = 0; index < assign->vars.size(); index++) {
       const auto &var = assign->vars[index];
-      // const auto &value = values[index];
 
       std::string variableName = "";
 
@@ -47,8 +74,8 @@ const std::vector<std::string> getFields(Statement *statement) {
         variableName.append("unknown");
       };
 
-      // TODO: display expression when we get an expression engine
-      fields.emplace_back(variableName + " = [expression]");
+      fields.emplace_back(variableName + " = " +
+                          describeValue(assign->values[index]));
     }
   } else if (auto stat = statement->as<ExpressionStatement>()) {
     if (auto expr = stat->value->as<Luau::AstExprCall>()) {
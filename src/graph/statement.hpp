@@ -1,18 +1,19 @@
 #pragma once
 
 #include <Luau/Ast.h>
+#include <cstddef>
 #include <string>
 #include <vector>
 
+#include "arena.hpp"
 #include "rtti.hpp"
 
-class Statement {
+// Allocated in the current GraphArena (see GraphNode), destructors never run.
+class Statement : public GraphNode {
 public:
   RTTI(Statement)
   const int classIndex;
 
-  virtual ~Statement() = default;
-
   explicit Statement(int classIndex) : classIndex(classIndex) {};
 
   template <typename T> T *as() {
@@ -30,8 +31,8 @@ public:
   RTTI(AssignStatement)
   explicit AssignStatement();
 
-  std::vector<Luau::AstExpr *> values;
-  std::vector<Luau::AstExpr *> vars; // can be AstExprLocal or AstExprGlobal
+  graph_vector<Luau::AstExpr *> values;
+  graph_vector<Luau::AstExpr *> vars; // can be AstExprLocal or AstExprGlobal
 };
 
 class LocalAssignStatement : public Statement {
@@ -39,8 +40,8 @@ public:
   RTTI(LocalAssignStatement)
   explicit LocalAssignStatement();
 
-  std::vector<Luau::AstExpr *> values;
-  std::vector<Luau::AstLocal *> vars;
+  graph_vector<Luau::AstExpr *> values;
+  graph_vector<Luau::AstLocal *> vars;
 };
 
 class CompoundAssignStatement : public Statement {
@@ -70,7 +71,7 @@ public:
   RTTI(ReturnStatement)
   explicit ReturnStatement();
 
-  std::vector<Luau::AstExpr *> values;
+  graph_vector<Luau::AstExpr *> values;
 };
 
 class ExpressionStatement : public Statement {
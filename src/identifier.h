@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// A generated identifier (see getNameAtIndex), stored inline so that renames
+// never allocate. Any size_t index fits in 12 characters.
+struct Identifier {
+  static constexpr size_t CAPACITY = 15;
+
+  char characters[CAPACITY] = {};
+  uint8_t length = 0;
+
+  constexpr Identifier() = default;
+
+  // e.g. a name read back from an incremental state file, names longer than
+  // CAPACITY are cut off
+  explicit constexpr Identifier(std::string_view name)
+      : length(static_cast<uint8_t>(
+            name.size() < CAPACITY ? name.size() : CAPACITY)) {
+    for (size_t index = 0; index < length; index++) {
+      characters[index] = name[index];
+    }
+  }
+
+  constexpr size_t size() const { return length; }
+  constexpr bool empty() const { return length == 0; }
+
+  constexpr std::string_view view() const { return {characters, length}; }
+  constexpr operator std::string_view() const { return view(); }
+
+  constexpr bool operator==(const Identifier &other) const {
+    return view() == other.view();
+  }
+};
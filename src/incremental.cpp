@@ -0,0 +1,525 @@
+#include <Luau/Ast.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include "incremental.h"
+#include "minifier.h"
+#include "syntax.h"
+#include "tracking.h"
+
+static constexpr char INCREMENTAL_STATE_MAGIC[4] = {'L', 'M', 'I', 'S'};
+static constexpr uint64_t INCREMENTAL_STATE_FORMAT = 10;
+
+static uint64_t hashString(std::string_view string) {
+  return ankerl::unordered_dense::hash<std::string_view>()(string);
+}
+
+static uint64_t combineHash(uint64_t seed, uint64_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+// Collects every local a statement declares, at any depth. This is a superset
+// of the locals it can add to (or rename in) the root BlockInfo.
+class DeclaredLocals : public Luau::AstVisitor {
+public:
+  std::vector<const char *> names = {};
+
+  bool visit(Luau::AstStatLocal *node) override {
+    for (const auto local : node->vars) {
+      names.emplace_back(local->name.value);
+    }
+
+    return true;
+  }
+
+  bool visit(Luau::AstStatLocalFunction *node) override {
+    names.emplace_back(node->name->name.value);
+    return true;
+  }
+
+  bool visit(Luau::AstExprFunction *node) override {
+    for (const auto local : node->args) {
+      names.emplace_back(local->name.value);
+    }
+
+    return true;
+  }
+
+  bool visit(Luau::AstStatFor *node) override {
+    names.emplace_back(node->var->name.value);
+    return true;
+  }
+
+  bool visit(Luau::AstStatForIn *node) override {
+    for (const auto local : node->vars) {
+      names.emplace_back(local->name.value);
+    }
+
+    return true;
+  }
+};
+
+// Fingerprints the names a top-level statement makes visible to the ones
+// after it, which decides whether those parse as locals or globals.
+static uint64_t fingerprintRootNames(uint64_t seed, Luau::AstStat *statement) {
+  if (auto local = statement->as<Luau::AstStatLocal>()) {
+    for (const auto var : local->vars) {
+      seed = combineHash(seed, hashString(var->name.value));
+    }
+  } else if (auto function = statement->as<Luau::AstStatLocalFunction>()) {
+    seed = combineHash(seed, hashString(function->name->name.value));
+  }
+
+  return seed;
+}
+
+static const IncrementalStatement *
+findPrevious(const IncrementalState &previous,
+             const ankerl::unordered_dense::map<uint64_t, std::vector<size_t>>
+                 &previousByHash,
+             uint64_t sourceHash,
+             const std::function<bool(const IncrementalStatement &)> &matches) {
+  const auto candidates = previousByHash.find(sourceHash);
+  if (candidates == previousByHash.end()) {
+    return nullptr;
+  }
+
+  for (const size_t index : candidates->second) {
+    if (matches(previous.statements[index])) {
+      return &previous.statements[index];
+    }
+  }
+
+  return nullptr;
+}
+
+void processAstRootIncremental(Luau::AstStatBlock *root,
+                               std::string_view source,
+                               const Luau::AstNameTable &names,
+                               IncrementalState &state, Output &output,
+                               IncrementalStats *stats) {
+  IncrementalStats counters = {.statements = root->body.size};
+  const std::vector<size_t> lineOffsets = getLineOffsets(source);
+
+  ankerl::unordered_dense::map<uint64_t, std::vector<size_t>> previousByHash;
+  for (size_t index = 0; index < state.statements.size(); index++) {
+    previousByHash[state.statements[index].sourceHash].emplace_back(index);
+  }
+
+  IncrementalState next = {};
+  next.statements.resize(root->body.size);
+
+  // analysis, statements keep their usage counts and scope summaries if their
+  // text and the names declared before them are unchanged. Folds and scopes
+  // are only worked out again for the statements which get emitted.
+  AstTracking tracking;
+  uint64_t rootNames = 0;
+
+  for (size_t index = 0; index < root->body.size; index++) {
+    Luau::AstStat *statement = root->body.data[index];
+    IncrementalStatement &record = next.statements[index];
+
+    record.sourceHash = hashString(
+        getLocationText(source, lineOffsets, statement->location));
+    record.entryNames = rootNames;
+
+    const IncrementalStatement *match =
+        findPrevious(state, previousByHash, record.sourceHash,
+                     [&](const IncrementalStatement &previous) {
+                       return previous.entryNames == record.entryNames;
+                     });
+
+    if (match != nullptr) {
+      record.globalUses = match->globalUses;
+      record.stringUses = match->stringUses;
+      record.scopes = match->scopes;
+    } else {
+      // counted without the dead code inside of the statement
+      AstTracking statementTracking;
+      statementTracking.foldConstants(statement);
+      record.scopes = statementTracking.trackStatementScopes(statement);
+      statement->visit(&statementTracking);
+
+      for (SymbolId id = 0; id < statementTracking.globalNames.size(); id++) {
+        record.globalUses.emplace_back(statementTracking.globalNames[id],
+                                       statementTracking.globalUses[id]);
+      }
+
+      for (SymbolId id = 0; id < statementTracking.strings.size(); id++) {
+        record.stringUses.emplace_back(statementTracking.strings[id],
+                                       statementTracking.stringUses[id]);
+      }
+
+      counters.retracked++;
+    }
+
+    rootNames = fingerprintRootNames(rootNames, statement);
+  }
+
+  std::vector<StatementScopes> scopes;
+  scopes.reserve(root->body.size);
+
+  for (const IncrementalStatement &record : next.statements) {
+    scopes.emplace_back(record.scopes);
+  }
+
+  tracking.removeDeadStatements(root, scopes);
+
+  for (size_t index = 0; index < root->body.size; index++) {
+    const IncrementalStatement &record = next.statements[index];
+
+    if (tracking.isRemoved(root->body.data[index])) {
+      continue;
+    }
+
+    // globals are keyed by their interned name, strings by their contents
+    // (which live in record until this function returns)
+    for (const auto &[name, uses] : record.globalUses) {
+      const SymbolId id = tracking.internGlobal(names.get(name.c_str()).value);
+      tracking.globalUses[id] += uses;
+    }
+
+    for (const auto &[string, uses] : record.stringUses) {
+      const SymbolId id = tracking.internString(string);
+      tracking.stringUses[id] += uses;
+    }
+  }
+
+  Glue glue = initGlue(tracking);
+  const bool glueChanged = glue.init != state.glue;
+
+  counters.fullRebuild = glueChanged && !state.statements.empty();
+  next.glue = glue.init;
+
+  // statement texts are recorded from this buffer, the sink only gets the
+  // finished output
+  Output buffer;
+  buffer.reserve(source.size());
+  buffer.append(glue.init);
+
+  // the root locals of reused statements are declared again without emitting
+  // them, the ones nested in them are never referenced from elsewhere
+  BlockInfo rootBlockInfo = {.parent = nullptr};
+  local_rename_map locals;
+  State emitState = {.output = buffer,
+                     .totalLocals = glue.nameIndex,
+                     .glueNames = glue.nameIndex,
+                     .tracking = tracking,
+                     .globals = glue.globals,
+                     .strings = glue.strings,
+                     .blockInfo = &rootBlockInfo,
+                     .locals = locals};
+
+  uint64_t rootRenames = 0;
+
+  for (size_t index = 0; index < root->body.size; index++) {
+    Luau::AstStat *statement = root->body.data[index];
+    IncrementalStatement &record = next.statements[index];
+
+    record.entryLocals = emitState.totalLocals;
+    record.entryRenames = rootRenames;
+    record.entryLast = buffer.empty() ? 0 : buffer.back();
+    record.removed = tracking.isRemoved(statement);
+
+    const IncrementalStatement *match =
+        glueChanged
+            ? nullptr
+            : findPrevious(state, previousByHash, record.sourceHash,
+                           [&](const IncrementalStatement &previous) {
+                             return previous.entryNames == record.entryNames &&
+                                    previous.entryLocals ==
+                                        record.entryLocals &&
+                                    previous.entryRenames ==
+                                        record.entryRenames &&
+                                    previous.entryLast == record.entryLast &&
+                                    previous.removed == record.removed;
+                           });
+
+    if (match != nullptr) {
+      record.text = match->text;
+      record.declarations = match->declarations;
+      record.exitLocals = match->exitLocals;
+
+      buffer.append(record.text);
+      declareRootLocals(statement, emitState.totalLocals, tracking, locals,
+                        rootBlockInfo.locals);
+      emitState.totalLocals = record.exitLocals;
+    } else {
+      DeclaredLocals declared;
+      statement->visit(&declared);
+
+      // remember what the root renames were, to find what the statement
+      // changed about them
+      std::vector<std::pair<const char *, std::string>> before;
+      for (const char *name : declared.names) {
+        const auto iterator = rootBlockInfo.locals.find(name);
+        before.emplace_back(name, iterator == rootBlockInfo.locals.end()
+                                      ? std::string()
+                                      : std::string(iterator->second));
+      }
+
+      if (!record.removed) {
+        tracking.foldConstants(statement);
+        tracking.trackStatementScopes(statement);
+      }
+
+      const size_t start = buffer.size();
+      handleStatement(statement, emitState);
+
+      record.text = std::string(buffer.pending().substr(start));
+      record.exitLocals = emitState.totalLocals;
+
+      ankerl::unordered_dense::set<const char *> recorded;
+      for (const auto &[name, previous] : before) {
+        const auto iterator = rootBlockInfo.locals.find(name);
+
+        if (iterator != rootBlockInfo.locals.end() &&
+            iterator->second.view() != previous &&
+            recorded.insert(name).second) {
+          record.declarations.emplace_back(name,
+                                           std::string(iterator->second));
+        }
+      }
+
+      counters.emitted++;
+    }
+
+    for (const auto &[name, renamed] : record.declarations) {
+      rootRenames = combineHash(rootRenames, hashString(name));
+      rootRenames = combineHash(rootRenames, hashString(renamed));
+    }
+  }
+
+  // handleNode does the same after the last statement of a block
+  addWhitespaceIfNeeded(buffer);
+  output.append(buffer.pending());
+
+  state = std::move(next);
+
+  if (stats != nullptr) {
+    *stats = counters;
+  }
+}
+
+static void writeInteger(std::string &output, uint64_t value) {
+  for (size_t index = 0; index < 8; index++) {
+    output.push_back((char)((value >> (index * 8)) & 0xff));
+  }
+}
+
+static void writeString(std::string &output, std::string_view string) {
+  writeInteger(output, string.size());
+  output.append(string);
+}
+
+class StateReader {
+public:
+  explicit StateReader(std::string_view data) : data(data) {}
+
+  template <typename T> bool integer(T &value) {
+    if (data.size() < 8) {
+      return false;
+    }
+
+    uint64_t wide = 0;
+    for (size_t index = 0; index < 8; index++) {
+      wide |= (uint64_t)(unsigned char)data[index] << (index * 8);
+    }
+
+    value = (T)wide;
+    data.remove_prefix(8);
+    return true;
+  }
+
+  bool string(std::string &value) {
+    uint64_t size;
+    if (!integer(size) || data.size() < size) {
+      return false;
+    }
+
+    value = std::string(data.substr(0, size));
+    data.remove_prefix(size);
+    return true;
+  }
+
+  bool strings(std::vector<std::string> &values) {
+    uint64_t count;
+    if (!integer(count) || count > data.size()) {
+      return false;
+    }
+
+    values.resize(count);
+    for (std::string &value : values) {
+      if (!string(value)) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  template <typename T>
+  bool pairs(std::vector<std::pair<std::string, T>> &values) {
+    uint64_t count;
+    if (!integer(count) || count > data.size()) {
+      return false;
+    }
+
+    values.resize(count);
+    for (auto &[first, second] : values) {
+      bool read;
+      if constexpr (std::is_same_v<T, std::string>) {
+        read = string(first) && string(second);
+      } else {
+        read = string(first) && integer(second);
+      }
+
+      if (!read) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+private:
+  std::string_view data;
+};
+
+bool loadIncrementalState(const std::string &path, IncrementalState &state) {
+  state = {};
+
+  std::ifstream file{path, std::ios_base::binary};
+  if (!file.is_open()) {
+    return false;
+  }
+
+  const std::string contents{std::istreambuf_iterator<char>(file),
+                             std::istreambuf_iterator<char>()};
+  std::string_view data = contents;
+
+  if (!data.starts_with(std::string_view(INCREMENTAL_STATE_MAGIC, 4))) {
+    return false;
+  }
+
+  StateReader reader(data.substr(4));
+  IncrementalState loaded = {};
+
+  uint64_t format, count;
+  if (!reader.integer(format) || format != INCREMENTAL_STATE_FORMAT ||
+      !reader.string(loaded.glue) || !reader.integer(count) ||
+      count > contents.size()) {
+    return false;
+  }
+
+  loaded.statements.resize(count);
+
+  for (auto &statement : loaded.statements) {
+    uint64_t jumps, empty, pure, entryLast, removed;
+
+    if (!reader.integer(statement.sourceHash) ||
+        !reader.integer(statement.entryNames) ||
+        !reader.pairs(statement.globalUses) ||
+        !reader.pairs(statement.stringUses) || !reader.integer(jumps) ||
+        !reader.integer(empty) || !reader.integer(pure) ||
+        !reader.strings(statement.scopes.rootReferences) ||
+        !reader.integer(statement.entryLocals) ||
+        !reader.integer(statement.entryRenames) ||
+        !reader.integer(entryLast) || !reader.integer(removed) ||
+        !reader.string(statement.text) ||
+        !reader.pairs(statement.declarations) ||
+        !reader.integer(statement.exitLocals)) {
+      return false;
+    }
+
+    statement.scopes.jumps = jumps != 0;
+    statement.scopes.empty = empty != 0;
+    statement.scopes.pure = pure != 0;
+    statement.entryLast = (char)entryLast;
+    statement.removed = removed != 0;
+  }
+
+  state = std::move(loaded);
+  return true;
+}
+
+bool saveIncrementalState(const std::string &path,
+                          const IncrementalState &state) {
+  std::string data(INCREMENTAL_STATE_MAGIC, 4);
+
+  writeInteger(data, INCREMENTAL_STATE_FORMAT);
+  writeString(data, state.glue);
+  writeInteger(data, state.statements.size());
+
+  for (const auto &statement : state.statements) {
+    writeInteger(data, statement.sourceHash);
+    writeInteger(data, statement.entryNames);
+
+    writeInteger(data, statement.globalUses.size());
+    for (const auto &[name, uses] : statement.globalUses) {
+      writeString(data, name);
+      writeInteger(data, uses);
+    }
+
+    writeInteger(data, statement.stringUses.size());
+    for (const auto &[string, uses] : statement.stringUses) {
+      writeString(data, string);
+      writeInteger(data, uses);
+    }
+
+    writeInteger(data, statement.scopes.jumps);
+    writeInteger(data, statement.scopes.empty);
+    writeInteger(data, statement.scopes.pure);
+
+    writeInteger(data, statement.scopes.rootReferences.size());
+    for (const std::string &name : statement.scopes.rootReferences) {
+      writeString(data, name);
+    }
+
+    writeInteger(data, statement.entryLocals);
+    writeInteger(data, statement.entryRenames);
+    writeInteger(data, (unsigned char)statement.entryLast);
+    writeInteger(data, statement.removed);
+    writeString(data, statement.text);
+
+    writeInteger(data, statement.declarations.size());
+    for (const auto &[name, renamed] : statement.declarations) {
+      writeString(data, name);
+      writeString(data, renamed);
+    }
+
+    writeInteger(data, statement.exitLocals);
+  }
+
+  // written next to the state and renamed over it, so that an interrupted
+  // write never leaves a truncated state behind
+  const std::string temporary =
+      path + ".tmp" + std::to_string(std::random_device()());
+
+  std::ofstream file{temporary, std::ios_base::binary | std::ios_base::trunc};
+  file.write(data.data(), data.size());
+  file.close();
+
+  std::error_code error;
+
+  if (!file) {
+    std::filesystem::remove(temporary, error);
+    return false;
+  }
+
+  std::filesystem::rename(temporary, path, error);
+
+  if (error) {
+    std::filesystem::remove(temporary, error);
+    return false;
+  }
+
+  return true;
+}
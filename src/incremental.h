@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Luau/Ast.h>
+#include <Luau/Lexer.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "minifier.h"
+#include "output.h"
+
+// Everything remembered about one top-level statement of a previous run.
+struct IncrementalStatement {
+  uint64_t sourceHash = 0;
+
+  // fingerprint of the names declared at the root before this statement;
+  // the same text can parse to locals or globals depending on it
+  uint64_t entryNames = 0;
+
+  // usage counts of the statement, as AstTracking would count them
+  std::vector<std::pair<std::string, size_t>> globalUses = {};
+  std::vector<std::pair<std::string, size_t>> stringUses = {};
+
+  // what deciding whether it is dead needs, from trackStatementScopes
+  StatementScopes scopes = {};
+
+  // emission state on entry; the emitted text is only valid for the same
+  // local counter, root renames and preceding character
+  size_t entryLocals = 0;
+  uint64_t entryRenames = 0;
+  char entryLast = 0;
+
+  // left out as dead code, which can depend on the statements after it
+  bool removed = false;
+
+  std::string text = "";
+
+  // root locals (name, renamed) declared by the statement, and the local
+  // counter after it
+  std::vector<std::pair<std::string, std::string>> declarations = {};
+  size_t exitLocals = 0;
+};
+
+struct IncrementalState {
+  std::string glue = ""; // Glue::init of the run
+  std::vector<IncrementalStatement> statements = {};
+};
+
+struct IncrementalStats {
+  size_t statements = 0;
+  size_t retracked = 0; // statements which went through AstTracking again
+  size_t emitted = 0;   // statements which went through handleNode again
+  bool fullRebuild = false; // the glue changed, nothing could be reused
+};
+
+// Minifies root like processAstRoot, producing byte-identical output, but
+// only re-analyzes and re-emits the top-level statements which differ from
+// state (the previous run). If the glue (global and string hoisting) changes,
+// every statement is emitted again. state is replaced by this run's state.
+// names must be the table root was parsed with, and source its text.
+void processAstRootIncremental(Luau::AstStatBlock *root,
+                               std::string_view source,
+                               const Luau::AstNameTable &names,
+                               IncrementalState &state, Output &output,
+                               IncrementalStats *stats = nullptr);
+
+bool loadIncrementalState(const std::string &path, IncrementalState &state);
+bool saveIncrementalState(const std::string &path,
+                          const IncrementalState &state);
@@ -1,22 +1,51 @@
+#include <chrono>
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <fstream>
-#include <ios>
+#include <filesystem>
 #include <iostream>
+#include <new>
 #include <optional>
-#include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
-#include "Luau/Location.h"
-#include "Luau/ParseOptions.h"
-#include "Luau/Parser.h"
-#include "minifier.h"
+#include "Luau/Common.h"
+#include "batch.h"
+#include "cache.h"
+#include "driver.h"
+#include "memory.h"
+#include "output.h"
+#include "server.h"
+#include "source.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define STDOUT_FILENO _fileno(stdout)
+#else
+#include <unistd.h>
+#endif
 
 static void displayHelp(const char *program_name) {
-  printf("Usage: %s [file]\nDotviz generator: %s --dotviz [file]\n",
-         program_name, program_name);
+  printf("Usage: %s [file]\nDotviz generator: %s --dotviz [file]\nBatch "
+         "mode: %s --batch <output directory> [-j threads] [--dotviz] "
+         "<directories, files or @file lists...>\nBundle mode: %s --bundle "
+         "<output file> <directories, files or @file lists...>\nServer mode: "
+         "%s --serve <socket path> [-j workers]\nEvery mode but bundles "
+         "accepts --cache <directory>, which caches outputs by the contents "
+         "of their input\n"
+         "Single files accept "
+         "--incremental <state file>, which only re-emits changed top-level "
+         "statements (not with --compressed or --cache), and -j <threads>, "
+         "which emits the top-level statements "
+         "of large files in parallel\nSingle files and batch mode accept "
+         "--compressed, which minimizes the gzip size rather than the raw "
+         "size\n--stats prints per-phase timings, "
+         "sizes and counts of single file runs to stderr\n--memory prints "
+         "allocations and peak memory by subsystem to stderr\n",
+         program_name, program_name, program_name, program_name,
+         program_name);
 }
 
 static int assertionHandler(const char *expr, const char *file, int line,
@@ -25,39 +54,171 @@ static int assertionHandler(const char *expr, const char *file, int line,
   return 1;
 }
 
-std::string formatLocation(const Luau::Location &location) {
-  std::ostringstream out;
+// Luau's arena pages come from the global operator new; they are attributed
+// to the Luau arena while the pipeline parses (see MemoryScope). Every block
+// starts with a header holding its size and subsystem, so that frees are
+// accounted too and the arena's current and peak bytes are real
+struct AllocationHeader {
+  size_t size;
+  MemorySubsystem subsystem; // Count if not attributed
+};
+
+// keeps the blocks malloc returns aligned for any type
+static constexpr size_t ALLOCATION_HEADER_SIZE =
+    __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+static_assert(sizeof(AllocationHeader) <= ALLOCATION_HEADER_SIZE);
 
-  Luau::Position begin = location.begin;
-  Luau::Position end = location.end;
+void *operator new(size_t size) {
+  void *block = malloc(ALLOCATION_HEADER_SIZE + size);
+
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
 
-  out << begin.line << ":" << begin.column << " - " << end.line << ":"
-      << end.column;
+  const MemorySubsystem subsystem = memoryAccountingEnabled()
+                                        ? recordScopedAllocation(size)
+                                        : MemorySubsystem::Count;
 
-  return out.str();
+  new (block) AllocationHeader{.size = size, .subsystem = subsystem};
+
+  return static_cast<char *>(block) + ALLOCATION_HEADER_SIZE;
 }
 
-std::optional<std::string> readFile(const std::string &name) {
-  std::ifstream file{name, std::ios_base::binary};
+void operator delete(void *pointer) noexcept {
+  if (pointer == nullptr) {
+    return;
+  }
+
+  void *block = static_cast<char *>(pointer) - ALLOCATION_HEADER_SIZE;
+  const AllocationHeader *header = static_cast<AllocationHeader *>(block);
 
-  if (!file.is_open()) {
-    return std::nullopt;
+  if (header->subsystem != MemorySubsystem::Count) {
+    recordRelease(header->subsystem, header->size);
   }
 
-  std::string contents;
-  std::string line;
+  free(block);
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete[](void *pointer) noexcept { operator delete(pointer); }
+void operator delete(void *pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+void operator delete[](void *pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+
+static void printMemoryReport() {
+  const MemoryReport report = memoryReport();
+
+  for (size_t index = 0; index < (size_t)MemorySubsystem::Count; index++) {
+    const MemoryUsage &usage = report.subsystems[index];
 
-  while (std::getline(file, line)) {
-    // if line is a shebang, skip
-    if (!(line.length() > 2 && line.at(0) == '#' && line.at(1) == '!')) {
-      contents.append(line);
-      contents.append("\n");
+    fprintf(stderr,
+            "%-22s %10zu allocations %14zu bytes, peak %14zu bytes\n",
+            memorySubsystemName((MemorySubsystem)index), usage.allocations,
+            usage.bytes, usage.peak);
+  }
+
+  fprintf(stderr, "%-22s %50zu bytes\n", "peak (all subsystems)",
+          report.peak);
+}
+
+static double milliseconds(std::chrono::nanoseconds duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static void printStats(const PipelineStats &stats,
+                       std::chrono::nanoseconds read,
+                       std::chrono::nanoseconds write) {
+  const std::chrono::nanoseconds total = read + stats.parse + stats.dot +
+                                         stats.minify.tracking +
+                                         stats.minify.glue + stats.minify.emit +
+                                         write;
+
+  const std::pair<const char *, std::chrono::nanoseconds> phases[] = {
+      {"read", read},
+      {"parse", stats.parse},
+      {"AstTracking", stats.minify.tracking},
+      {"initGlue", stats.minify.glue},
+      {"handleNode", stats.minify.emit},
+      {"generateDot", stats.dot},
+      {"write", write},
+  };
+
+  // phases which did not run (dotviz, cache hits, incremental) are skipped
+  for (const auto &[phase, duration] : phases) {
+    if (duration.count() != 0) {
+      fprintf(stderr, "%-12s %10.3f ms\n", phase, milliseconds(duration));
     }
   }
 
-  file.close();
+  const double seconds = std::chrono::duration<double>(total).count();
+  const double megabytes = stats.bytesIn / (1024.0 * 1024.0);
+
+  fprintf(stderr, "%-12s %10.3f ms (%.2f MB/s)%s\n", "total",
+          milliseconds(total), seconds > 0 ? megabytes / seconds : 0.0,
+          stats.cacheHit ? ", cache hit" : "");
+  fprintf(stderr, "bytes in: %zu, bytes out: %zu (%.1f%%)\n", stats.bytesIn,
+          stats.bytesOut,
+          stats.bytesIn > 0 ? 100.0 * stats.bytesOut / stats.bytesIn : 0.0);
 
-  return contents;
+  if (stats.minify.emit.count() != 0) {
+    fprintf(stderr, "globals: %zu, hoisted strings: %zu, locals: %zu\n",
+            stats.minify.globals, stats.minify.strings, stats.minify.locals);
+  }
+
+  if (stats.minify.removed != 0) {
+    fprintf(stderr, "dead code: %zu statements, %zu bytes of source removed\n",
+            stats.minify.removed, stats.minify.removedBytes);
+  }
+
+  if (stats.minify.compressed != 0) {
+    fprintf(stderr,
+            "compressed (estimated): %zu bytes, default options: %zu bytes, "
+            "%zu compressed\n",
+            stats.minify.compressed, stats.minify.defaultRaw,
+            stats.minify.defaultCompressed);
+  }
+}
+
+static int runBatchMode(int argc, char **argv, const ResultCache *cache,
+                        size_t workers, OutputMode mode) {
+  BatchOptions options = {.mode = mode, .workers = workers, .cache = cache};
+  std::vector<std::string> inputs;
+
+  for (int index = 0; index < argc; index++) {
+    if (strcmp(argv[index], "--dotviz") == 0) {
+      options.mode = OutputMode::Dotviz;
+    } else if (options.outputDirectory.empty()) {
+      options.outputDirectory = argv[index];
+    } else {
+      inputs.emplace_back(argv[index]);
+    }
+  }
+
+  if (options.outputDirectory.empty() || inputs.empty()) {
+    return 1;
+  }
+
+  std::vector<BatchEntry> entries;
+  bool collected = collectBatchEntries(inputs, options, entries);
+
+  size_t failures = runBatch(entries, options);
+
+  return (collected && failures == 0) ? 0 : 1;
+}
+
+static int runBundleMode(int argc, char **argv) {
+  const std::filesystem::path output = argv[0];
+  std::vector<std::string> inputs(argv + 1, argv + argc);
+
+  std::vector<BatchEntry> entries;
+  if (!collectBatchEntries(inputs, BatchOptions(), entries)) {
+    return 1;
+  }
+
+  return runBundle(entries, output) ? 0 : 1;
 }
 
 int main(int argc, char **argv) {
@@ -68,6 +229,93 @@ int main(int argc, char **argv) {
     if (strncmp(flag->name, "Luau", 4) == 0)
       flag->value = true;
 
+  // options which apply to every mode are taken out of argv
+  std::optional<ResultCache> cache;
+  const char *incrementalState = nullptr;
+  bool printPipelineStats = false;
+  bool printMemory = false;
+  bool compressed = false;
+  std::optional<size_t> jobs;
+  std::vector<char *> arguments;
+
+  for (int index = 0; index < argc; index++) {
+    if (strcmp(argv[index], "--cache") == 0 && index + 1 < argc) {
+      cache.emplace(argv[++index]);
+    } else if (strcmp(argv[index], "--incremental") == 0 && index + 1 < argc) {
+      incrementalState = argv[++index];
+    } else if (strcmp(argv[index], "--stats") == 0) {
+      printPipelineStats = true;
+    } else if (strcmp(argv[index], "--memory") == 0) {
+      printMemory = true;
+    } else if (strcmp(argv[index], "-j") == 0 && index + 1 < argc) {
+      jobs = strtoul(argv[++index], nullptr, 10);
+    } else if (strcmp(argv[index], "--compressed") == 0) {
+      compressed = true;
+    } else {
+      arguments.emplace_back(argv[index]);
+    }
+  }
+
+  argc = (int)arguments.size();
+  argv = arguments.data();
+
+  // incremental runs reuse the statements of the last run, they neither
+  // search for the smallest compressed output nor read whole outputs from
+  // the cache
+  if (incrementalState != nullptr && (compressed || cache)) {
+    std::cerr << "--incremental can't be combined with --compressed or --cache"
+              << std::endl;
+    return 1;
+  }
+
+  const ResultCache *resultCache = cache ? &cache.value() : nullptr;
+  const OutputMode minifyMode =
+      compressed ? OutputMode::MinifyCompressed : OutputMode::Minify;
+
+  enableMemoryAccounting(printMemory);
+
+  if (argc >= 2 && strcmp(argv[1], "--batch") == 0) {
+    if (argc < 4) {
+      displayHelp(argv[0]);
+      return 1;
+    }
+
+    // batch mode runs a file per worker, every file is emitted serially
+    const int status =
+        runBatchMode(argc - 2, argv + 2, resultCache, jobs.value_or(0),
+                     minifyMode);
+
+    if (printMemory) {
+      printMemoryReport();
+    }
+
+    return status;
+  }
+
+  if (argc >= 2 && strcmp(argv[1], "--bundle") == 0) {
+    if (argc < 4) {
+      displayHelp(argv[0]);
+      return 1;
+    }
+
+    const int status = runBundleMode(argc - 2, argv + 2);
+
+    if (printMemory) {
+      printMemoryReport();
+    }
+
+    return status;
+  }
+
+  if (argc >= 2 && strcmp(argv[1], "--serve") == 0) {
+    if (argc != 3) {
+      displayHelp(argv[0]);
+      return 1;
+    }
+
+    return runServer(argv[2], resultCache, jobs.value_or(0));
+  }
+
   if (argc >= 2 && strcmp(argv[1], "--help") == 0) {
     displayHelp(argv[0]);
     return 0;
@@ -78,50 +326,93 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  using clock = std::chrono::steady_clock;
+  clock::time_point start;
+
+  if (printPipelineStats) {
+    start = clock::now();
+  }
+
   const char *name = (argc == 3) ? argv[2] : argv[1];
-  std::string source;
+  SourceFile source;
 
   if (strcmp(name, "-") == 0) {
-    // read from stdin
-    std::string line;
-    while (std::getline(std::cin, line)) {
-      source.append(line);
-      source.append("\n");
-    }
+    source = SourceFile::readStdin();
   } else {
-    // read from file
-    std::optional<std::string> fileContents = readFile(name);
+    std::optional<SourceFile> file = SourceFile::open(name);
 
-    if (fileContents == std::nullopt) {
+    if (file == std::nullopt) {
       std::cerr << "failed reading file: " << name << std::endl;
       return 1;
     }
 
-    source = fileContents.value();
+    source = std::move(file.value());
+  }
+
+  clock::duration readTime = {};
+
+  if (printPipelineStats) {
+    readTime = clock::now() - start;
   }
 
-  Luau::Allocator allocator;
-  Luau::AstNameTable names(allocator);
-  Luau::ParseOptions options;
+  FdSink stdoutSink(STDOUT_FILENO);
+  PipelineResult result;
+  IncrementalStats stats;
+  PipelineStats pipelineStats;
+
+  // with --stats the output is buffered whole, so that writing it is not
+  // counted as part of emitting it
+  OutputSink *sink = printPipelineStats ? nullptr : &stdoutSink;
+  PipelineStats *pipelineStatsPointer =
+      printPipelineStats ? &pipelineStats : nullptr;
 
-  Luau::ParseResult parseResult = Luau::Parser::parse(
-      source.data(), source.size(), names, allocator, options);
+  if (incrementalState != nullptr && argc != 3) {
+    result = runIncrementalPipeline(source.text(), incrementalState, sink,
+                                    &stats, pipelineStatsPointer);
+  } else {
+    result = runPipeline(source.text(),
+                         (argc != 3) ? minifyMode : OutputMode::Dotviz,
+                         sink, resultCache, pipelineStatsPointer,
+                         jobs.value_or(1));
+  }
 
-  if (!parseResult.errors.empty()) {
+  if (!result.errors.empty()) {
     std::cerr << "Parse errors were encountered:" << std::endl;
-    for (const Luau::ParseError &error : parseResult.errors) {
-      fprintf(stderr, "  %s - %s\n",
-              formatLocation(error.getLocation()).c_str(),
-              error.getMessage().c_str());
+    for (const std::string &error : result.errors) {
+      fprintf(stderr, "%s\n", error.c_str());
     }
 
     return 1;
   }
 
-  if (argc != 3) {
-    std::cout << processAstRoot(parseResult.root) << std::endl;
-  } else {
-    std::cout << generateDot(parseResult.root) << std::endl;
+  if (printPipelineStats) {
+    start = clock::now();
+  }
+
+  if (sink == nullptr) {
+    stdoutSink.write(result.output);
+  }
+
+  stdoutSink.write("\n");
+
+  if (printPipelineStats) {
+    printStats(pipelineStats, readTime, clock::now() - start);
+
+    if (incrementalState != nullptr && argc != 3) {
+      fprintf(stderr,
+              "incremental: %zu of %zu statements emitted, %zu analyzed%s\n",
+              stats.emitted, stats.statements, stats.retracked,
+              stats.fullRebuild ? " (glue changed, full rebuild)" : "");
+    }
+  }
+
+  if (printMemory) {
+    printMemoryReport();
+  }
+
+  if (!stdoutSink.good()) {
+    std::cerr << "failed writing output" << std::endl;
+    return 1;
   }
 
   return 0;
@@ -0,0 +1,132 @@
+#include <atomic>
+#include <utility>
+
+#include "memory.h"
+
+struct AtomicMemoryUsage {
+  std::atomic<size_t> allocations = 0;
+  std::atomic<size_t> bytes = 0;
+  std::atomic<size_t> current = 0;
+  std::atomic<size_t> peak = 0;
+};
+
+static AtomicMemoryUsage usages[(size_t)MemorySubsystem::Count];
+
+static std::atomic<size_t> totalCurrent = 0;
+static std::atomic<size_t> totalPeak = 0;
+
+static thread_local MemoryScope *activeScope = nullptr;
+
+static void raisePeak(std::atomic<size_t> &peak, size_t value) {
+  size_t previous = peak.load(std::memory_order_relaxed);
+
+  while (previous < value &&
+         !peak.compare_exchange_weak(previous, value,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+// releases never take a counter below zero, memory allocated before
+// accounting was enabled can still be released afterwards
+static void lower(std::atomic<size_t> &counter, size_t value) {
+  size_t previous = counter.load(std::memory_order_relaxed);
+
+  while (!counter.compare_exchange_weak(
+      previous, previous > value ? previous - value : 0,
+      std::memory_order_relaxed)) {
+  }
+}
+
+void enableMemoryAccounting(bool enabled) {
+  memoryAccountingActive.store(enabled, std::memory_order_relaxed);
+}
+
+void recordAllocation(MemorySubsystem subsystem, size_t bytes) {
+  if (!memoryAccountingEnabled()) {
+    return;
+  }
+
+  AtomicMemoryUsage &usage = usages[(size_t)subsystem];
+
+  usage.allocations.fetch_add(1, std::memory_order_relaxed);
+  usage.bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+  raisePeak(usage.peak,
+            usage.current.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+  raisePeak(totalPeak,
+            totalCurrent.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+void recordRelease(MemorySubsystem subsystem, size_t bytes) {
+  if (!memoryAccountingEnabled()) {
+    return;
+  }
+
+  lower(usages[(size_t)subsystem].current, bytes);
+  lower(totalCurrent, bytes);
+}
+
+MemoryReport memoryReport() {
+  MemoryReport report = {};
+
+  for (size_t index = 0; index < (size_t)MemorySubsystem::Count; index++) {
+    const AtomicMemoryUsage &usage = usages[index];
+
+    report.subsystems[index] = {
+        .allocations = usage.allocations.load(std::memory_order_relaxed),
+        .bytes = usage.bytes.load(std::memory_order_relaxed),
+        .current = usage.current.load(std::memory_order_relaxed),
+        .peak = usage.peak.load(std::memory_order_relaxed),
+    };
+  }
+
+  report.peak = totalPeak.load(std::memory_order_relaxed);
+
+  return report;
+}
+
+void resetMemoryAccounting() {
+  for (AtomicMemoryUsage &usage : usages) {
+    usage.allocations.store(0, std::memory_order_relaxed);
+    usage.bytes.store(0, std::memory_order_relaxed);
+    usage.current.store(0, std::memory_order_relaxed);
+    usage.peak.store(0, std::memory_order_relaxed);
+  }
+
+  totalCurrent.store(0, std::memory_order_relaxed);
+  totalPeak.store(0, std::memory_order_relaxed);
+}
+
+const char *memorySubsystemName(MemorySubsystem subsystem) {
+  switch (subsystem) {
+  case MemorySubsystem::LuauArena:
+    return "Luau arena";
+  case MemorySubsystem::Graph:
+    return "Block/Statement graph";
+  case MemorySubsystem::RenameMaps:
+    return "rename maps";
+  case MemorySubsystem::Output:
+    return "output";
+  default:
+    return "unknown";
+  }
+}
+
+MemoryScope *MemoryScope::enter() {
+  return std::exchange(activeScope, this);
+}
+
+void MemoryScope::leave(MemoryScope *previous) { activeScope = previous; }
+
+MemorySubsystem recordScopedAllocation(size_t bytes) {
+  MemoryScope *scope = activeScope;
+
+  if (scope == nullptr || !memoryAccountingEnabled()) {
+    return MemorySubsystem::Count;
+  }
+
+  scope->attributed += bytes;
+  recordAllocation(scope->subsystem, bytes);
+
+  return scope->subsystem;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/*
+  Opt-in accounting of the minifier's heap usage, split by subsystem. While
+  disabled (the default), every hook is a single relaxed atomic load.
+
+  - LuauArena:  pages of the Luau::Allocator the parser fills (and the
+                parser's scratch buffers). Luau gets them from the global
+                operator new, so they are only seen when the host reports its
+                allocations and frees through recordScopedAllocation and
+                recordRelease (the CLI does); see MemoryScope.
+  - Graph:      pages of the GraphArena the Block and Statement nodes built
+                for the dot graph (and their containers) live in.
+  - RenameMaps: growth of every rename_map (BlockInfo locals, renamed
+                locals) and of the glue's symbol_renames.
+  - Output:     growth of the Output buffers State emits into.
+
+  Counters are global and shared by every thread.
+*/
+
+enum class MemorySubsystem : uint8_t {
+  LuauArena = 0,
+  Graph,
+  RenameMaps,
+  Output,
+  Count,
+};
+
+struct MemoryUsage {
+  size_t allocations = 0;
+  size_t bytes = 0;   // allocated in total
+  size_t current = 0; // allocated and not released yet
+  size_t peak = 0;    // highest current
+};
+
+struct MemoryReport {
+  MemoryUsage subsystems[(size_t)MemorySubsystem::Count] = {};
+  size_t peak = 0; // highest sum of every subsystem's current
+};
+
+// checked inline by every hook, see enableMemoryAccounting
+inline std::atomic<bool> memoryAccountingActive = false;
+
+void enableMemoryAccounting(bool enabled);
+
+inline bool memoryAccountingEnabled() {
+  return memoryAccountingActive.load(std::memory_order_relaxed);
+}
+
+void recordAllocation(MemorySubsystem subsystem, size_t bytes);
+void recordRelease(MemorySubsystem subsystem, size_t bytes);
+
+MemoryReport memoryReport();
+void resetMemoryAccounting();
+
+const char *memorySubsystemName(MemorySubsystem subsystem);
+
+// Attributes the allocations a host reports through recordScopedAllocation on
+// this thread to subsystem, while a track() call runs. They are released as
+// the host reports them freed, whether or not the scope is still alive.
+class MemoryScope {
+public:
+  explicit MemoryScope(MemorySubsystem subsystem) : subsystem(subsystem) {}
+  MemoryScope(const MemoryScope &) = delete;
+  MemoryScope &operator=(const MemoryScope &) = delete;
+
+  template <typename F> void track(F &&function) {
+    if (!memoryAccountingEnabled()) {
+      function();
+      return;
+    }
+
+    MemoryScope *previous = enter();
+    function();
+    leave(previous);
+  }
+
+  size_t bytes() const { return attributed; } // in total, freed or not
+
+private:
+  friend MemorySubsystem recordScopedAllocation(size_t bytes);
+
+  MemorySubsystem subsystem;
+  size_t attributed = 0;
+
+  MemoryScope *enter();
+  void leave(MemoryScope *previous);
+};
+
+// For hosts which replace the global operator new: attributes bytes to the
+// MemoryScope active on this thread, if any. Returns the subsystem they went
+// to (MemorySubsystem::Count if none), which the host passes to recordRelease
+// with the same bytes once they are freed, on any thread.
+MemorySubsystem recordScopedAllocation(size_t bytes);
+
+// Standard allocator which records every allocation under Subsystem, for
+// containers such as rename_map.
+template <typename T, MemorySubsystem Subsystem> struct AccountingAllocator {
+  using value_type = T;
+
+  template <typename U> struct rebind {
+    using other = AccountingAllocator<U, Subsystem>;
+  };
+
+  AccountingAllocator() noexcept = default;
+
+  template <typename U>
+  AccountingAllocator(const AccountingAllocator<U, Subsystem> &) noexcept {}
+
+  T *allocate(size_t count) {
+    recordAllocation(Subsystem, count * sizeof(T));
+    return static_cast<T *>(::operator new(count * sizeof(T)));
+  }
+
+  void deallocate(T *pointer, size_t count) noexcept {
+    recordRelease(Subsystem, count * sizeof(T));
+    ::operator delete(pointer);
+  }
+
+  template <typename U>
+  bool operator==(const AccountingAllocator<U, Subsystem> &) const noexcept {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const AccountingAllocator<U, Subsystem> &) const noexcept {
+    return false;
+  }
+};
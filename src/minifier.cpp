@@ -1,24 +1,68 @@
 #include <Luau/Ast.h>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <charconv>
+#include <chrono>
 #include <cstddef>
 #include <cstdio>
 #include <functional>
 #include <limits>
-#include <reflex/matcher.h>
+#include <memory>
 #include <string_view>
 #include <system_error>
+#include <thread>
+#include <vector>
 
+#include "dispatch.h"
 #include "minifier.h"
 #include "syntax.h"
 
+// Gives local the name at index, in the current block
+static Identifier nameLocal(const Luau::AstLocal *local, size_t index,
+                            State &state) {
+  const Identifier name = getNameAtIndex(index);
+
+  state.locals[local] = {.name = name, .index = index};
+  state.blockInfo->locals[local->name.value] = name;
+  state.highestLocal = std::max(state.highestLocal, index);
+
+  return name;
+}
+
 // Creates and appends a variable name for an AstLocal, based on state's current
 // totalLocals, which should get incremented before this function call.
 void handleAstLocalAssignment(const Luau::AstLocal *local, State &state) {
-  const std::string name = getNameAtIndex(state.totalLocals);
+  state.output.append(nameLocal(local, state.totalLocals, state));
+}
 
-  state.blockInfo->locals[local->name.value] = name;
-  state.output.append(name);
+// Numbers the locals of scope (a block, function or for loop) from right above
+// the highest outer local it refers to, or the glue: the outer locals above
+// that can be shadowed, nothing in the scope needs them. Returns the counter
+// to put back once the scope ends, so that the scopes after it reuse its
+// names. Scopes which weren't tracked, or which refer to a local that isn't
+// known by declaration, keep counting up.
+static size_t enterScope(const Luau::AstNode *scope, State &state) {
+  const size_t outer = state.totalLocals;
+
+  const auto uses = state.tracking.outerLocals(scope);
+  if (uses == nullptr) {
+    return outer;
+  }
+
+  size_t first = state.glueNames;
+
+  for (const Luau::AstLocal *local : *uses) {
+    const auto renamed = state.locals.find(local);
+    if (renamed == state.locals.end()) {
+      return outer;
+    }
+
+    first = std::max(first, renamed->second.index);
+  }
+
+  state.totalLocals = first;
+  return outer;
 }
 
 // Calls the closure in the scope of block. block is added to the state's
@@ -36,536 +80,963 @@ void callAsChildBlock(State &state, BlockInfo *block,
   state.blockInfo = currentInfo;
 };
 
-void handleNode(const Luau::AstNode *node, State &state) {
-  if (node->is<Luau::AstStatBlock>()) {
-    // top level block, do blocks, functions
-    const auto block = node->as<Luau::AstStatBlock>();
+// top level block, do blocks, functions
+static void handleStatBlock(const Luau::AstStatBlock *block, State &state) {
+  const size_t outerLocals = enterScope(block, state);
 
-    for (const auto &node : block->body) {
-      handleNode(node, state);
-    }
+  for (const auto &node : block->body) {
+    handleStatement(node, state);
+  }
 
-    // TODO: Is this code relevant?
-    /*  for (const auto &[depth, _] : state.locals) {
-          if (depth - 1 > blockDepth) {
-            state.locals[depth] = {};
-          }
-        }
-    */
+  state.totalLocals = outerLocals;
+  addWhitespaceIfNeeded(state.output);
+}
 
-    addWhitespaceIfNeeded(state.output);
-  } else if (node->is<Luau::AstStatExpr>()) {
-    addWhitespaceIfNeeded(state.output);
-    handleNode(node->as<Luau::AstStatExpr>()->expr, state);
-  } else if (node->is<Luau::AstExprCall>()) {
-    const auto call = node->as<Luau::AstExprCall>();
-    addWhitespaceIfNeeded(state.output);
+// the block's locals may reuse names of the enclosing block, so unlike other
+// bodies it has to stay a block in the output
+static void handleStatDo(const Luau::AstStatBlock *block, State &state) {
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("do ");
 
-    handleNode(call->func, state);
+  BlockInfo doBlock = {};
+  callAsChildBlock(state, &doBlock, [&] { handleStatBlock(block, state); });
 
-    state.output.append("(");
+  state.output.append("end ");
+}
 
-    for (size_t index = 0; index < call->args.size; index++) {
-      const auto argument = call->args.data[index];
+static void handleStatExpr(const Luau::AstStatExpr *statement, State &state) {
+  addWhitespaceIfNeeded(state.output);
+  handleNode(statement->expr, state);
+}
 
-      handleNode(argument, state);
+static void handleExprCall(const Luau::AstExprCall *call, State &state) {
+  addWhitespaceIfNeeded(state.output);
 
-      if (index < call->args.size - 1) {
-        state.output.append(",");
-      }
+  handleNode(call->func, state);
+
+  state.output.append("(");
+
+  for (size_t index = 0; index < call->args.size; index++) {
+    const auto argument = call->args.data[index];
+
+    handleNode(argument, state);
+
+    if (index < call->args.size - 1) {
+      state.output.append(",");
     }
+  }
 
-    state.output.append(")");
-  } else if (node->is<Luau::AstStatLocal>()) {
-    const auto statement = node->as<Luau::AstStatLocal>();
-    addWhitespaceIfNeeded(state.output);
-    State assignValuesState = State{.output = "",
-                                    .totalLocals = state.totalLocals,
-                                    .globals = state.globals,
-                                    .strings = state.strings,
-                                    .blockInfo = state.blockInfo};
+  state.output.append(")");
+}
 
-    // don't emit more values than there are variables
-    size_t totalAssignments =
-        std::min(statement->values.size, statement->vars.size);
+static void handleStatLocal(const Luau::AstStatLocal *statement, State &state) {
+  addWhitespaceIfNeeded(state.output);
 
-    state.output.append("local ");
+  // don't emit more values than there are variables
+  size_t totalAssignments =
+      std::min(statement->values.size, statement->vars.size);
 
-    for (size_t index = 0; index < totalAssignments; index++) {
-      const auto value = statement->values.data[index];
-      const auto local = statement->vars.data[index];
+  // the variables are named first, but only become visible after all their
+  // values are emitted
+  const size_t firstLocal = state.totalLocals;
 
-      state.totalLocals++;
-      handleAstLocalAssignment(local, state);
-      handleNode(value, assignValuesState);
+  state.output.append("local ");
 
-      if (index < totalAssignments - 1) {
-        assignValuesState.output.append(",");
-        state.output.append(",");
-      }
+  for (size_t index = 0; index < totalAssignments; index++) {
+    state.output.append(getNameAtIndex(firstLocal + index + 1));
+
+    if (index < totalAssignments - 1) {
+      state.output.append(",");
     }
+  }
 
-    state.output.append("=");
-    state.output.append(assignValuesState.output);
-    addWhitespaceIfNeeded(state.output);
-  } else if (node->is<Luau::AstExprLocal>()) {
-    const auto local = node->as<Luau::AstExprLocal>()->local;
-
-    /*
-      Traverse the function hierachy in order to find renamed local variables at
-      higher function stacks. Start at the current function, if it exists, and
-      go backward in the hierachy, checking each function stack to see if it has
-      this local variable's name. Stops when a stack is found, or when info ==
-      nullptr (a parent of nullptr is the root node).
-    */
-    BlockInfo *info = state.blockInfo;
-    while (info != nullptr) {
-      if (info->locals.contains(local->name.value)) {
-        state.output.append(info->locals[local->name.value]);
-        return;
-      }
+  state.output.append("=");
 
-      info = info->parent;
+  // locals declared inside the values are numbered from firstLocal, as the
+  // variables' names are not in use yet
+  for (size_t index = 0; index < totalAssignments; index++) {
+    handleNode(statement->values.data[index], state);
+
+    if (index < totalAssignments - 1) {
+      state.output.append(",");
     }
+  }
 
-    state.output.append("unknown");
-  } else if (node->is<Luau::AstStatAssign>()) {
-    const auto assign = node->as<Luau::AstStatAssign>();
-    addWhitespaceIfNeeded(state.output);
+  for (size_t index = 0; index < totalAssignments; index++) {
+    nameLocal(statement->vars.data[index], firstLocal + index + 1, state);
+  }
 
-    State assignedValuesState = State{
-        .output = "",
-        .totalLocals = state.totalLocals,
-        .globals = state.globals,
-        .strings = state.strings,
-        .blockInfo = state.blockInfo,
-    };
-
-    for (size_t index = 0; index < assign->values.size; index++) {
-      const auto value = assign->values.data[index];
-      handleNode(value, assignedValuesState);
-      if (index < assign->values.size - 1) {
-        assignedValuesState.output.append(",");
-      }
+  state.totalLocals = firstLocal + totalAssignments;
+  addWhitespaceIfNeeded(state.output);
+}
+
+static void handleExprLocal(const Luau::AstExprLocal *expr, State &state) {
+  const auto local = expr->local;
+
+  const auto renamed = state.locals.find(local);
+  if (renamed != state.locals.end()) {
+    state.output.append(renamed->second.name);
+    return;
+  }
+
+  /*
+    The declaration wasn't emitted in this run (incremental mode reuses the
+    text of unchanged statements). Traverse the function hierachy in order to
+    find renamed local variables at higher function stacks. Start at the
+    current function, if it exists, and go backward in the hierachy, checking
+    each function stack to see if it has this local variable's name. Stops
+    when a stack is found, or when info == nullptr (a parent of nullptr is the
+    root node).
+  */
+  BlockInfo *info = state.blockInfo;
+  while (info != nullptr) {
+    if (info->locals.contains(local->name.value)) {
+      state.output.append(info->locals[local->name.value]);
+      return;
     }
 
-    for (size_t index = 0; index < assign->vars.size; index++) {
-      const auto expr = assign->vars.data[index];
+    info = info->parent;
+  }
 
-      if (expr->is<Luau::AstExprLocal>()) {
-        state.totalLocals++;
-      }
+  state.output.append("unknown");
+}
 
-      handleNode(expr, state);
+static void handleStatAssign(const Luau::AstStatAssign *assign, State &state) {
+  addWhitespaceIfNeeded(state.output);
 
-      if (index < assign->vars.size - 1) {
-        state.output.append(",");
-      }
+  for (size_t index = 0; index < assign->vars.size; index++) {
+    handleNode(assign->vars.data[index], state);
+
+    if (index < assign->vars.size - 1) {
+      state.output.append(",");
     }
+  }
 
-    if (assign->values.size > 0) {
-      state.output.append("=");
+  if (assign->values.size > 0) {
+    state.output.append("=");
+  }
+
+  for (size_t index = 0; index < assign->values.size; index++) {
+    const auto value = assign->values.data[index];
+    handleNode(value, state);
+    if (index < assign->values.size - 1) {
+      state.output.append(",");
     }
+  }
 
-    state.output.append(assignedValuesState.output);
-    addWhitespaceIfNeeded(state.output);
-  } else if (node->is<Luau::AstExprVarargs>()) {
-    state.output.append("...");
-  } else if (node->is<Luau::AstExprGlobal>()) {
-    const auto expr = node->as<Luau::AstExprGlobal>();
+  addWhitespaceIfNeeded(state.output);
+}
 
-    // originalName -> translatedName
-    state.output.append(state.globals[expr->name.value]);
-  } else if (node->is<Luau::AstExprConstantNumber>()) {
-    const auto expr = node->as<Luau::AstExprConstantNumber>();
+static void handleExprVarargs(const Luau::AstExprVarargs *, State &state) {
+  state.output.append("...");
+}
 
-    if (expr->parseResult == Luau::ConstantNumberParseResult::Imprecise) {
+static void handleExprGlobal(const Luau::AstExprGlobal *expr, State &state) {
+  const SymbolId id = state.tracking.findGlobal(expr->name.value);
+
+  // originalName -> translatedName
+  if (id < state.globals.size()) {
+    state.output.append(state.globals[id]);
+  } else {
+    state.output.append(expr->name.value);
+  }
+}
+
+static void handleExprConstantNumber(const Luau::AstExprConstantNumber *expr,
+                                     State &state) {
+  if (expr->parseResult == Luau::ConstantNumberParseResult::Imprecise) {
+    state.output.append("1.7976931348623157e+308");
+  } else if (expr->parseResult ==
+                 Luau::ConstantNumberParseResult::HexOverflow ||
+             expr->parseResult ==
+                 Luau::ConstantNumberParseResult::BinOverflow) {
+    state.output.append("0xffffffffffffffff");
+  } else if (expr->parseResult == Luau::ConstantNumberParseResult::Ok) {
+    std::string characterDataBuffer(
+        std::numeric_limits<double>::max_digits10 + 2, (char)0);
+
+    auto result = std::to_chars(
+        characterDataBuffer.data(),
+        characterDataBuffer.data() + characterDataBuffer.size(), expr->value);
+    if (result.ec == std::errc::value_too_large) {
+      // TODO: is this really right?
       state.output.append("1.7976931348623157e+308");
-    } else if (expr->parseResult ==
-                   Luau::ConstantNumberParseResult::HexOverflow ||
-               expr->parseResult ==
-                   Luau::ConstantNumberParseResult::BinOverflow) {
-      state.output.append("0xffffffffffffffff");
-    } else if (expr->parseResult == Luau::ConstantNumberParseResult::Ok) {
-      std::string characterDataBuffer(
-          std::numeric_limits<double>::max_digits10 + 2, (char)0);
-
-      auto result = std::to_chars(
-          characterDataBuffer.data(),
-          characterDataBuffer.data() + characterDataBuffer.size(), expr->value);
-      if (result.ec == std::errc::value_too_large) {
-        // TODO: is this really right?
-        state.output.append("1.7976931348623157e+308");
-        return;
-      }
-      state.output.append(std::string(characterDataBuffer.data(), result.ptr));
-    };
-  } else if (node->is<Luau::AstExprConstantString>()) {
-    const auto expr = node->as<Luau::AstExprConstantString>();
-    std::string_view view(expr->value.begin(), expr->value.end());
-
-    if (state.strings.contains(view)) {
-      state.output.append(state.strings[view]);
       return;
     }
+    state.output.append(std::string(characterDataBuffer.data(), result.ptr));
+  };
+}
+
+static void handleExprConstantString(const Luau::AstExprConstantString *expr,
+                                     State &state) {
+  const SymbolId id = state.tracking.findString(expr);
+
+  if (id < state.strings.size() && !state.strings[id].empty()) {
+    state.output.append(state.strings[id]);
+    return;
+  }
 
-    state.output.append("\"");
+  const std::string_view view(expr->value.begin(), expr->value.end());
 
-    if (expr->value.size != 0) {
-      appendRawString(state.output, replaceAll(std::string(expr->value.begin(),
-                                                           expr->value.end()),
-                                               "\"", "\\\""));
+  state.output.append("\"");
+  appendEscapedString(state.output, view, '"');
+  state.output.append("\"");
+}
+
+static void handleExprConstantBool(const Luau::AstExprConstantBool *expr,
+                                   State &state) {
+  if (expr->value) {
+    state.output.append("true");
+  } else if (state.compactFalse) {
+    state.output.append("1==0"); // false = 5 chars, 1==0 = 4 chars
+  } else {
+    state.output.append("false");
+  }
+}
+
+static void handleExprConstantNil(const Luau::AstExprConstantNil *,
+                                  State &state) {
+  state.output.append("nil");
+}
+
+static void handleExprInterpString(const Luau::AstExprInterpString *expr,
+                                   State &state) {
+  state.output.append("`");
+
+  for (size_t index = 0; index < expr->strings.size; index++) {
+    const auto &string = expr->strings.data[index];
+    appendEscapedString(state.output,
+                        std::string_view(string.begin(), string.end()), '`');
+
+    // the last string never has a corresponding expression
+    if (index != expr->strings.size - 1) {
+      auto expression = expr->expressions.data[index];
+
+      state.output.append("{");
+      handleNode(expression, state);
+      state.output.append("}");
     }
+  }
+
+  state.output.append("`");
+}
 
-    state.output.append("\"");
-  } else if (node->is<Luau::AstExprConstantBool>()) {
-    const auto expr = node->as<Luau::AstExprConstantBool>();
-    if (expr->value) {
-      state.output.append("true");
-    } else {
-      state.output.append("1==0"); // false = 5 chars, 1==0 = 4 chars
+static void handleExprTable(const Luau::AstExprTable *expr, State &state) {
+  state.output.append("{");
+
+  for (size_t index = 0; index < expr->items.size; index++) {
+    const auto &item = expr->items.data[index];
+    if (item.key != nullptr) {
+      state.output.append("[");
+      handleNode(item.key, state);
+      state.output.append("]=");
     }
-  } else if (node->is<Luau::AstExprConstantNil>()) {
-    state.output.append("nil");
-  } else if (node->is<Luau::AstExprInterpString>()) {
-    const auto expr = node->as<Luau::AstExprInterpString>();
-
-    state.output.append("`");
-
-    for (size_t index = 0; index < expr->strings.size; index++) {
-      auto string = expr->strings.data[index];
-      if (string.size != 0) {
-        appendRawString(
-            state.output,
-            replaceAll(std::string(string.begin(), string.end()), "`", "\\`"));
-      };
-
-      // the last string never has a corresponding expression
-      if (index != expr->strings.size - 1) {
-        auto expression = expr->expressions.data[index];
-
-        state.output.append("{");
-        handleNode(expression, state);
-        state.output.append("}");
-      }
+
+    handleNode(item.value, state);
+
+    if (index < expr->items.size - 1) {
+      state.output.append(",");
     }
+  }
 
-    state.output.append("`");
-  } else if (node->is<Luau::AstExprTable>()) {
-    const auto expr = node->as<Luau::AstExprTable>();
-    state.output.append("{");
-
-    for (size_t index = 0; index < expr->items.size; index++) {
-      const auto &item = expr->items.data[index];
-      if (item.key != nullptr) {
-        state.output.append("[");
-        handleNode(item.key, state);
-        state.output.append("]=");
-      }
+  state.output.append("}");
+}
+
+static void handleExprIndexName(const Luau::AstExprIndexName *expr,
+                                State &state) {
+  handleNode(expr->expr, state);
+  state.output.append(1, expr->op);
+  state.output.append(expr->index.value);
+}
 
-      handleNode(item.value, state);
+static void handleStatCompoundAssign(const Luau::AstStatCompoundAssign *expr,
+                                     State &state) {
+  handleNode(expr->var, state);
+  state.output.append(compoundSymbols[expr->op]);
+  state.output.append("=");
+  handleNode(expr->value, state);
+
+  addWhitespaceIfNeeded(state.output);
+}
+
+// Writes the literal expr was folded into, if it was
+static bool handleFolded(const Luau::AstExpr *expr, State &state) {
+  const std::string *literal = state.tracking.folded(expr);
+  if (literal == nullptr) {
+    return false;
+  }
+
+  state.output.append(*literal);
+  return true;
+}
+
+// An operator's operand, where false can't be written as 1==0
+static void handleOperand(const Luau::AstExpr *expr, State &state) {
+  const auto boolean = expr->as<Luau::AstExprConstantBool>();
+  if (boolean != nullptr && !boolean->value) {
+    state.output.append("false");
+    return;
+  }
 
-      if (index < expr->items.size - 1) {
+  handleNode(expr, state);
+}
+
+static void handleExprUnary(const Luau::AstExprUnary *unary, State &state) {
+  if (handleFolded(unary, state)) {
+    return;
+  }
+
+  // a minus after a minus would start a comment
+  if (unary->op == Luau::AstExprUnary::Minus && !state.output.empty() &&
+      state.output.back() == '-') {
+    state.output.append(" ");
+  }
+
+  state.output.append(unarySymbol(unary->op));
+  handleOperand(unary->expr, state);
+}
+
+static void handleExprBinary(const Luau::AstExprBinary *binary, State &state) {
+  if (handleFolded(binary, state)) {
+    return;
+  }
+
+  handleOperand(binary->left, state);
+
+  // 1..x would be read as one malformed number, whatever operand the 1
+  // ended (x+1..y, -1..y)
+  if (binary->op == Luau::AstExprBinary::Concat && !state.output.empty() &&
+      (std::isdigit((unsigned char)state.output.back()) ||
+       state.output.back() == '.')) {
+    state.output.append(" ");
+  }
+
+  state.output.append(compoundSymbols[binary->op]);
+  handleOperand(binary->right, state);
+}
+
+/*
+  This only covers the following snippet:
+  if <cond> then
+    <MANDATORY_THEN_BODY>
+  else
+    <ELSE_BODY_CAN_BE_NULLPTR>
+  end
+*/
+static void handleStatIf(const Luau::AstStatIf *ifStatement, State &state) {
+  state.output.append("if ");
+  handleNode(ifStatement->condition, state);
+  addWhitespaceIfNeeded(state.output);
+
+  BlockInfo thenBlock = {};
+  BlockInfo elseBlock = {};
+
+  state.output.append("then ");
+  callAsChildBlock(state, &thenBlock,
+                   [&] { handleNode(ifStatement->thenbody, state); });
+
+  if (ifStatement->elsebody != nullptr) {
+    addWhitespaceIfNeeded(state.output);
+    state.output.append("else ");
+
+    callAsChildBlock(state, &elseBlock,
+                     [&] { handleNode(ifStatement->elsebody, state); });
+  }
+
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("end ");
+}
+
+static void handleExprIfElse(const Luau::AstExprIfElse *expr, State &state) {
+  state.output.append("if ");
+  handleNode(expr->condition, state);
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("then ");
+
+  handleNode(expr->trueExpr, state);
+  if (expr->hasElse) {
+    state.output.append(" else");
+    state.output.append((expr->falseExpr->is<Luau::AstExprIfElse>() ||
+                                 expr->falseExpr->is<Luau::AstStatIf>()
+                             ? ""
+                             : " "));
+    handleNode(expr->falseExpr, state);
+  }
+}
+
+static void handleStatFunction(const Luau::AstStatFunction *function,
+                               State &state) {
+  addWhitespaceIfNeeded(state.output);
+  handleNode(function->name, state);
+  state.output.append("=");
+  handleNode(function->func, state);
+}
+
+// the arguments and body of a function, from the opening parenthesis
+static void handleFunctionBody(const Luau::AstExprFunction *expr,
+                               State &state) {
+  state.output.append("(");
+
+  BlockInfo functionBlock = {};
+  const size_t outerLocals = enterScope(expr, state);
+
+  // handle function arguments and body in same block, to prevent leakage onto
+  // the state's current block info
+  callAsChildBlock(state, &functionBlock, [&] {
+    for (size_t index = 0; index < expr->args.size; index++) {
+      const auto functionArgument = expr->args.data[index];
+
+      state.totalLocals++;
+      handleAstLocalAssignment(functionArgument, state);
+
+      if (index < expr->args.size - 1) {
         state.output.append(",");
       }
     }
 
-    state.output.append("}");
-  } else if (node->is<Luau::AstExprIndexName>()) {
-    const auto expr = node->as<Luau::AstExprIndexName>();
+    if (expr->vararg) {
+      if (expr->args.size > 0) {
+        state.output.append(",");
+      }
+      state.output.append("...");
+    }
 
-    handleNode(expr->expr, state);
-    state.output.append(1, expr->op);
-    state.output.append(expr->index.value);
-  } else if (node->is<Luau::AstStatCompoundAssign>()) {
-    const auto expr = node->as<Luau::AstStatCompoundAssign>();
+    state.output.append(")");
+
+    handleNode(expr->body, state);
+  });
+
+  state.output.append("end");
+  state.totalLocals = outerLocals;
+}
+
+static void handleExprFunction(const Luau::AstExprFunction *expr,
+                               State &state) {
+  state.output.append("function");
+  handleFunctionBody(expr, state);
+}
+
+// local function f, rather than local f=function (which is as long): only the
+// former lets f call itself
+static void
+handleStatLocalFunction(const Luau::AstStatLocalFunction *local_function,
+                        State &state) {
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("local function ");
+  state.totalLocals++;
+  handleAstLocalAssignment(local_function->name, state);
+
+  handleFunctionBody(local_function->func, state);
+}
+
+static void handleExprIndexExpr(const Luau::AstExprIndexExpr *expr,
+                                State &state) {
+  addWhitespaceIfNeeded(state.output);
+
+  handleNode(expr->expr, state);
 
-    handleNode(expr->var, state);
-    state.output.append(compoundSymbols[expr->op]);
+  state.output.append("[");
+  handleNode(expr->index, state);
+  state.output.append("]");
+}
+
+static void handleStatWhile(const Luau::AstStatWhile *while_statement,
+                            State &state) {
+  BlockInfo whileBlockInfo = {};
+
+  addWhitespaceIfNeeded(state.output);
+
+  state.output.append("while ");
+  handleNode(while_statement->condition, state);
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("do ");
+
+  callAsChildBlock(state, &whileBlockInfo,
+                   [&] { handleNode(while_statement->body, state); });
+
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("end ");
+}
+
+static void handleExprGroup(const Luau::AstExprGroup *group, State &state) {
+  if (handleFolded(group, state)) {
+    return;
+  }
+
+  state.output.append("(");
+  handleNode(group->expr, state);
+  state.output.append(")");
+}
+
+static void handleStatFor(const Luau::AstStatFor *forStatement, State &state) {
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("for ");
+
+  // the loop variable's name is only used inside the loop, so the outer
+  // numbering continues from where it was once the loop is emitted
+  const size_t totalLocals = enterScope(forStatement, state);
+  state.totalLocals++;
+
+  // the loop variable and body get their own block, so that their names
+  // don't leak onto the state's current block info
+  BlockInfo forStatementBlock = {};
+  callAsChildBlock(state, &forStatementBlock, [&] {
+    handleAstLocalAssignment(forStatement->var, state);
     state.output.append("=");
-    handleNode(expr->value, state);
+    handleNode(forStatement->from, state);
+    state.output.append(",");
+    handleNode(forStatement->to, state);
 
-    addWhitespaceIfNeeded(state.output);
-  } else if (node->is<Luau::AstExprUnary>()) {
-    const auto unary = node->as<Luau::AstExprUnary>();
-
-    state.output.append(compoundSymbols[unary->op]);
-    handleNode(unary->expr, state);
-  } else if (node->is<Luau::AstExprBinary>()) {
-    const auto binary = node->as<Luau::AstExprBinary>();
-
-    handleNode(binary->left, state);
-    state.output.append(compoundSymbols[binary->op]);
-    handleNode(binary->right, state);
-  } else if (node->is<Luau::AstStatIf>()) {
-    /*
-      This only covers the following snippet:
-      if <cond> then
-        <MANDATORY_THEN_BODY>
-      else
-        <ELSE_BODY_CAN_BE_NULLPTR>
-      end
-    */
-    const auto ifStatement = node->as<Luau::AstStatIf>();
-
-    state.output.append("if ");
-    handleNode(ifStatement->condition, state);
-    addWhitespaceIfNeeded(state.output);
+    if (forStatement->step != nullptr) {
+      state.output.append(",");
+      handleNode(forStatement->step, state);
+    }
 
-    BlockInfo thenBlock = {};
-    BlockInfo elseBlock = {};
+    state.output.append(" do ");
 
-    state.output.append("then ");
-    callAsChildBlock(state, &thenBlock,
-                     [&] { handleNode(ifStatement->thenbody, state); });
+    handleNode(forStatement->body, state);
+  });
 
-    if (ifStatement->elsebody != nullptr) {
-      addWhitespaceIfNeeded(state.output);
-      state.output.append("else ");
+  state.output.append("end ");
+  state.totalLocals = totalLocals;
+}
+
+static void handleStatForIn(const Luau::AstStatForIn *forInStatement,
+                            State &state) {
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("for ");
 
-      callAsChildBlock(state, &elseBlock,
-                       [&] { handleNode(ifStatement->elsebody, state); });
+  const size_t outerLocals = enterScope(forInStatement, state);
+
+  // handle for in loop arguments and body in same block, to prevent leakage
+  // onto the state's current block info
+  BlockInfo forInStatementBlock = {};
+  callAsChildBlock(state, &forInStatementBlock, [&] {
+    for (size_t index = 0; index < forInStatement->vars.size; index++) {
+      auto localVariable = forInStatement->vars.data[index];
+      state.totalLocals++;
+
+      handleAstLocalAssignment(localVariable, state);
+
+      if (index < forInStatement->vars.size - 1) {
+        state.output.append(",");
+      }
     }
 
     addWhitespaceIfNeeded(state.output);
-    state.output.append("end ");
-  } else if (node->is<Luau::AstExprIfElse>()) {
-    const auto expr = node->as<Luau::AstExprIfElse>();
+    state.output.append("in ");
 
-    state.output.append("if ");
-    handleNode(expr->condition, state);
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("then ");
-
-    handleNode(expr->trueExpr, state);
-    if (expr->hasElse) {
-      state.output.append(" else");
-      state.output.append((expr->falseExpr->is<Luau::AstExprIfElse>() ||
-                                   expr->falseExpr->is<Luau::AstStatIf>()
-                               ? ""
-                               : " "));
-      handleNode(expr->falseExpr, state);
+    for (size_t index = 0; index < forInStatement->values.size; index++) {
+      const auto value = forInStatement->values.data[index];
+      handleNode(value, state);
+      if (index < forInStatement->values.size - 1) {
+        state.output.append(",");
+      }
     }
-  } else if (node->is<Luau::AstStatLocalFunction>()) {
-    const auto local_function = node->as<Luau::AstStatLocalFunction>();
 
     addWhitespaceIfNeeded(state.output);
-    state.output.append("local ");
-    state.totalLocals++;
-    handleAstLocalAssignment(local_function->name, state);
+    state.output.append("do ");
 
-    state.output.append("=");
-    handleNode(local_function->func, state);
-  } else if (node->is<Luau::AstStatFunction>()) {
-    const auto function = node->as<Luau::AstStatFunction>();
+    handleNode(forInStatement->body, state);
 
     addWhitespaceIfNeeded(state.output);
-    handleNode(function->name, state);
-    state.output.append("=");
-    handleNode(function->func, state);
-  } else if (node->is<Luau::AstExprFunction>()) {
-    const auto expr = node->as<Luau::AstExprFunction>();
+    state.output.append("end ");
+  });
 
-    state.output.append("function(");
+  state.totalLocals = outerLocals;
+}
 
-    BlockInfo functionBlock = {};
+static void handleStatRepeat(const Luau::AstStatRepeat *repeatStatement,
+                             State &state) {
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("repeat ");
 
-    // handle function arguments and body in same block, to prevent leakage onto
-    // the state's current block info
-    callAsChildBlock(state, &functionBlock, [&] {
-      for (size_t index = 0; index < expr->args.size; index++) {
-        const auto functionArgument = expr->args.data[index];
+  BlockInfo repeatStatementBlock = {};
 
-        state.totalLocals++;
-        handleAstLocalAssignment(functionArgument, state);
+  callAsChildBlock(state, &repeatStatementBlock,
+                   [&] { handleNode(repeatStatement->body, state); });
 
-        if (index < expr->args.size - 1) {
-          state.output.append(",");
-        }
-      }
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("until ");
+  handleNode(repeatStatement->condition, state);
+  addWhitespaceIfNeeded(state.output);
+}
 
-      if (expr->vararg) {
-        if (expr->args.size > 0) {
-          state.output.append(",");
-        }
-        state.output.append("...");
-      }
+static void handleStatBreak(const Luau::AstStatBreak *, State &state) {
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("break;");
+}
 
-      state.output.append(")");
+static void handleStatReturn(const Luau::AstStatReturn *return_statement,
+                             State &state) {
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("return ");
 
-      handleNode(expr->body, state);
-    });
+  for (size_t index = 0; index < return_statement->list.size; index++) {
+    const auto node = return_statement->list.data[index];
+    handleNode(node, state);
 
-    state.output.append("end");
-  } else if (node->is<Luau::AstExprIndexExpr>()) {
-    const auto expr = node->as<Luau::AstExprIndexExpr>();
-    addWhitespaceIfNeeded(state.output);
+    if (index < return_statement->list.size - 1) {
+      state.output.append(",");
+    }
+  }
 
-    handleNode(expr->expr, state);
+  state.output.append(";");
+}
 
-    state.output.append("[");
-    handleNode(expr->index, state);
-    state.output.append("]");
+static void handleStatContinue(const Luau::AstStatContinue *, State &state) {
+  addWhitespaceIfNeeded(state.output);
+  state.output.append("continue;");
+}
 
-  } else if (node->is<Luau::AstStatWhile>()) {
-    const auto while_statement = node->as<Luau::AstStatWhile>();
+static NodeDispatch<State> makeHandlers() {
+  NodeDispatch<State> handlers;
+
+  handlers
+      .on<Luau::AstStatBlock, handleStatBlock>()
+      .on<Luau::AstStatExpr, handleStatExpr>()
+      .on<Luau::AstExprCall, handleExprCall>()
+      .on<Luau::AstStatLocal, handleStatLocal>()
+      .on<Luau::AstExprLocal, handleExprLocal>()
+      .on<Luau::AstStatAssign, handleStatAssign>()
+      .on<Luau::AstExprVarargs, handleExprVarargs>()
+      .on<Luau::AstExprGlobal, handleExprGlobal>()
+      .on<Luau::AstExprConstantNumber, handleExprConstantNumber>()
+      .on<Luau::AstExprConstantString, handleExprConstantString>()
+      .on<Luau::AstExprConstantBool, handleExprConstantBool>()
+      .on<Luau::AstExprConstantNil, handleExprConstantNil>()
+      .on<Luau::AstExprInterpString, handleExprInterpString>()
+      .on<Luau::AstExprTable, handleExprTable>()
+      .on<Luau::AstExprIndexName, handleExprIndexName>()
+      .on<Luau::AstStatCompoundAssign, handleStatCompoundAssign>()
+      .on<Luau::AstExprUnary, handleExprUnary>()
+      .on<Luau::AstExprBinary, handleExprBinary>()
+      .on<Luau::AstStatIf, handleStatIf>()
+      .on<Luau::AstExprIfElse, handleExprIfElse>()
+      .on<Luau::AstStatLocalFunction, handleStatLocalFunction>()
+      .on<Luau::AstStatFunction, handleStatFunction>()
+      .on<Luau::AstExprFunction, handleExprFunction>()
+      .on<Luau::AstExprIndexExpr, handleExprIndexExpr>()
+      .on<Luau::AstStatWhile, handleStatWhile>()
+      .on<Luau::AstExprGroup, handleExprGroup>()
+      .on<Luau::AstStatFor, handleStatFor>()
+      .on<Luau::AstStatForIn, handleStatForIn>()
+      .on<Luau::AstStatRepeat, handleStatRepeat>()
+      .on<Luau::AstStatBreak, handleStatBreak>()
+      .on<Luau::AstStatReturn, handleStatReturn>()
+      .on<Luau::AstStatContinue, handleStatContinue>();
+
+  return handlers;
+}
 
-    BlockInfo whileBlockInfo = {};
+static const NodeDispatch<State> &emitHandlers() {
+  static const NodeDispatch<State> handlers = makeHandlers();
+  return handlers;
+}
 
-    addWhitespaceIfNeeded(state.output);
+void handleNode(const Luau::AstNode *node, State &state) {
+  // unhandled nodes have no entry, and are skipped
+  emitHandlers()(node, state);
+}
 
-    state.output.append("while ");
-    handleNode(while_statement->condition, state);
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("do ");
+void handleStatement(const Luau::AstStat *statement, State &state) {
+  if (state.tracking.isRemoved(statement)) {
+    return;
+  }
 
-    callAsChildBlock(state, &whileBlockInfo,
-                     [&] { handleNode(while_statement->body, state); });
+  if (const auto block = statement->as<Luau::AstStatBlock>()) {
+    handleStatDo(block, state);
+    return;
+  }
 
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("end ");
-  } else if (node->is<Luau::AstExprGroup>()) {
-    const auto group = node->as<Luau::AstExprGroup>();
-    state.output.append("(");
-    handleNode(group->expr, state);
-    state.output.append(")");
-  } else if (node->is<Luau::AstStatFor>()) {
-    const auto forStatement = node->as<Luau::AstStatFor>();
+  handleNode(statement, state);
+}
 
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("for ");
-
-    // we don't do state.totalLocals++ here because the variable would only be
-    // used in the new state
-    State forLoopState{.output = "",
-                       .totalLocals = state.totalLocals + 1,
-                       .globals = state.globals,
-                       .strings = state.strings,
-                       .blockInfo = state.blockInfo};
-
-    // handle for loop arguments and body in same block, to prevent leakage onto
-    // the state's current block info
-    BlockInfo forStatementBlockInfo = {};
-    callAsChildBlock(state, &forStatementBlockInfo, [&] {
-      handleAstLocalAssignment(forStatement->var, forLoopState);
-      forLoopState.output.append("=");
-      handleNode(forStatement->from, forLoopState);
-      forLoopState.output.append(",");
-      handleNode(forStatement->to, forLoopState);
-
-      if (forStatement->step != nullptr) {
-        forLoopState.output.append(",");
-        handleNode(forStatement->step, forLoopState);
-      }
+/*
+  Parallel emission of the root block. Once the glue is fixed, a top-level
+  statement's output only depends on the local counter it starts at, on the
+  root locals declared before it, and on whether the text before it ends in
+  whitespace. The first two are worked out by rootLocals and
+  declareRootLocals without emitting anything, the last one is settled while
+  stitching (see Output::requestLeadingWhitespace).
+*/
+
+// How many root locals a top-level statement declares, which is all that
+// emitting it does to state.totalLocals: nested scopes give their numbers back
+// once they end (see enterScope).
+static size_t rootLocals(const Luau::AstStat *statement,
+                         const AstTracking &tracking) {
+  if (tracking.isRemoved(statement)) {
+    return 0;
+  }
 
-      forLoopState.output.append(" ");
+  if (const auto local = statement->as<Luau::AstStatLocal>()) {
+    return std::min(local->values.size, local->vars.size);
+  }
 
-      addWhitespaceIfNeeded(state.output);
-      forLoopState.output.append("do ");
+  return statement->is<Luau::AstStatLocalFunction>() ? 1 : 0;
+}
 
-      handleNode(forStatement->body, forLoopState);
-    });
+// Counts the nodes under a statement, to estimate what emitting it costs
+class NodeCounter : public Luau::AstVisitor {
+public:
+  size_t nodes = 0;
 
-    addWhitespaceIfNeeded(state.output);
-    forLoopState.output.append("end ");
-    state.output.append(forLoopState.output);
-  } else if (node->is<Luau::AstStatForIn>()) {
-    const auto forInStatement = node->as<Luau::AstStatForIn>();
+  bool visit(Luau::AstExpr *) override {
+    nodes++;
+    return true;
+  }
 
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("for ");
+  bool visit(Luau::AstStat *) override {
+    nodes++;
+    return true;
+  }
+};
 
-    // handle for in loop arguments and body in same block, to prevent leakage
-    // onto the state's current block info
-    BlockInfo forInStatementBlock = {};
-    callAsChildBlock(state, &forInStatementBlock, [&] {
-      for (size_t index = 0; index < forInStatement->vars.size; index++) {
-        auto localVariable = forInStatement->vars.data[index];
-        state.totalLocals++;
+// Names the root locals a top-level statement declares, as handleStatLocal
+// and handleStatLocalFunction would when it starts at entry.
+void declareRootLocals(const Luau::AstStat *statement, size_t entry,
+                       const AstTracking &tracking, local_rename_map &locals,
+                       rename_map &names) {
+  if (tracking.isRemoved(statement)) {
+    return;
+  }
 
-        handleAstLocalAssignment(localVariable, state);
+  if (const auto local = statement->as<Luau::AstStatLocal>()) {
+    const size_t totalAssignments =
+        std::min(local->values.size, local->vars.size);
 
-        if (index < forInStatement->vars.size - 1) {
-          state.output.append(",");
-        }
-      }
+    for (size_t index = 0; index < totalAssignments; index++) {
+      const Luau::AstLocal *var = local->vars.data[index];
+      const Identifier name = getNameAtIndex(entry + index + 1);
 
-      addWhitespaceIfNeeded(state.output);
-      state.output.append("in ");
-
-      for (size_t index = 0; index < forInStatement->values.size; index++) {
-        const auto value = forInStatement->values.data[index];
-        handleNode(value, state);
-        if (index < forInStatement->values.size - 1) {
-          state.output.append(",");
-        }
-      }
+      locals[var] = {.name = name, .index = entry + index + 1};
+      names[var->name.value] = name;
+    }
+  } else if (const auto function =
+                 statement->as<Luau::AstStatLocalFunction>()) {
+    const Identifier name = getNameAtIndex(entry + 1);
 
-      addWhitespaceIfNeeded(state.output);
-      state.output.append("do ");
+    locals[function->name] = {.name = name, .index = entry + 1};
+    names[function->name->name.value] = name;
+  }
+}
 
-      handleNode(forInStatement->body, state);
+// consecutive top-level statements emitted by one task
+struct EmitChunk {
+  size_t begin = 0;
+  size_t end = 0;
+  size_t entry = 0; // predicted state.totalLocals before begin
 
-      addWhitespaceIfNeeded(state.output);
-      state.output.append("end ");
-    });
-  } else if (node->is<Luau::AstStatRepeat>()) {
-    const auto repeatStatement = node->as<Luau::AstStatRepeat>();
+  // root locals declared before begin
+  local_rename_map locals = {};
+  rename_map names = {};
 
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("repeat ");
+  Output output;
+  size_t exit = 0;    // state.totalLocals after end, once emitted
+  size_t highest = 0; // state.highestLocal, once emitted
+};
 
-    BlockInfo repeatStatementBlock = {};
+// a statement's chunk gets at least this many nodes, so that small sources
+// are never split up
+static constexpr size_t PARALLEL_CHUNK_NODES = 16 * 1024;
+
+// Emits root's statements on workers threads into state.output, identically
+// to handleNode(root, state). Returns false, having emitted nothing, if the
+// source is too small to be split up or a chunk didn't end where the next
+// one was predicted to start (which would be a bug in rootLocals).
+static bool emitParallel(Luau::AstStatBlock *root, State &state,
+                         size_t workers) {
+  const size_t statements = root->body.size;
+
+  std::vector<size_t> statementLocals(statements);
+  std::vector<size_t> statementNodes(statements);
+  size_t totalNodes = 0;
+
+  for (size_t index = 0; index < statements; index++) {
+    NodeCounter counter;
+    root->body.data[index]->visit(&counter);
+
+    statementLocals[index] =
+        rootLocals(root->body.data[index], state.tracking);
+    statementNodes[index] = counter.nodes;
+    totalNodes += counter.nodes;
+  }
 
-    callAsChildBlock(state, &repeatStatementBlock,
-                     [&] { handleNode(repeatStatement->body, state); });
+  // a few chunks per worker, so that one big function doesn't hold up the
+  // rest
+  const size_t chunkNodes =
+      std::max(PARALLEL_CHUNK_NODES, totalNodes / (workers * 4));
 
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("until ");
-    handleNode(repeatStatement->condition, state);
-    addWhitespaceIfNeeded(state.output);
-  } else if (node->is<Luau::AstStatBreak>()) {
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("break;");
-  } else if (node->is<Luau::AstStatReturn>()) {
-    const auto return_statement = node->as<Luau::AstStatReturn>();
+  if (totalNodes < 2 * chunkNodes) {
+    return false;
+  }
 
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("return ");
+  std::vector<std::unique_ptr<EmitChunk>> chunks;
+  local_rename_map locals;
+  rename_map names;
+  size_t entry = state.totalLocals;
+  size_t nodes = 0;
+
+  for (size_t index = 0; index < statements; index++) {
+    if (chunks.empty() || nodes >= chunkNodes) {
+      if (!chunks.empty()) {
+        chunks.back()->end = index;
+      }
 
-    for (size_t index = 0; index < return_statement->list.size; index++) {
-      const auto node = return_statement->list.data[index];
-      handleNode(node, state);
+      chunks.emplace_back(std::make_unique<EmitChunk>());
+      chunks.back()->begin = index;
+      chunks.back()->entry = entry;
+      chunks.back()->locals = locals;
+      chunks.back()->names = names;
+      nodes = 0;
+    }
 
-      if (index < return_statement->list.size - 1) {
-        state.output.append(",");
+    declareRootLocals(root->body.data[index], entry, state.tracking, locals,
+                      names);
+    entry += statementLocals[index];
+    nodes += statementNodes[index];
+  }
+
+  chunks.back()->end = statements;
+
+  if (chunks.size() < 2) {
+    return false;
+  }
+
+  std::atomic<size_t> next = 0;
+  const auto work = [&] {
+    for (size_t index = next++; index < chunks.size(); index = next++) {
+      EmitChunk &chunk = *chunks[index];
+      BlockInfo rootBlockInfo = {.locals = std::move(chunk.names)};
+
+      State chunkState = {.output = chunk.output,
+                          .totalLocals = chunk.entry,
+                          .glueNames = state.glueNames,
+                          .tracking = state.tracking,
+                          .globals = state.globals,
+                          .strings = state.strings,
+                          .blockInfo = &rootBlockInfo,
+                          .locals = chunk.locals,
+                          .compactFalse = state.compactFalse};
+
+      for (size_t statement = chunk.begin; statement < chunk.end;
+           statement++) {
+        handleStatement(root->body.data[statement], chunkState);
       }
+
+      chunk.exit = chunkState.totalLocals;
+      chunk.highest = chunkState.highestLocal;
     }
+  };
 
-    state.output.append(";");
-  } else if (node->is<Luau::AstStatContinue>()) {
-    addWhitespaceIfNeeded(state.output);
-    state.output.append("continue;");
-  } else {
-    // unhandled node
-    return;
+  std::vector<std::thread> threads;
+  const size_t threadCount = std::min(workers, chunks.size()) - 1;
+  threads.reserve(threadCount);
+
+  for (size_t index = 0; index < threadCount; index++) {
+    threads.emplace_back(work);
+  }
+
+  work();
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (size_t index = 0; index + 1 < chunks.size(); index++) {
+    if (chunks[index]->exit != chunks[index + 1]->entry) {
+      return false;
+    }
   }
+
+  for (const auto &chunk : chunks) {
+    if (chunk->output.leadingWhitespaceRequested()) {
+      addWhitespaceIfNeeded(state.output);
+    }
+
+    state.output.append(chunk->output.pending());
+    state.highestLocal = std::max(state.highestLocal, chunk->highest);
+  }
+
+  // the end of handleStatBlock, which gives the root's numbers back
+  addWhitespaceIfNeeded(state.output);
+
+  return true;
 }
 
-std::string processAstRoot(Luau::AstStatBlock *root) {
-  AstTracking tracking;
+void processAstRoot(Luau::AstStatBlock *root, Output &output,
+                    MinifyStats *stats) {
+  MinifyWorkspace workspace;
+  processAstRoot(root, output, workspace, stats);
+}
+
+void processAstRoot(Luau::AstStatBlock *root, Output &output,
+                    MinifyWorkspace &workspace, MinifyStats *stats,
+                    size_t workers, const EmitOptions &options) {
+  using clock = std::chrono::steady_clock;
+  clock::time_point start;
+
+  if (stats != nullptr) {
+    start = clock::now();
+  }
+
+  AstTracking &tracking = workspace.tracking;
+  tracking.clear();
+
+  tracking.foldConstants(root);
+  tracking.trackScopes(root);
   root->visit(&tracking);
 
-  Glue glue = initGlue(tracking);
-  BlockInfo rootBlockInfo = {.parent = nullptr};
+  if (stats != nullptr) {
+    const clock::time_point now = clock::now();
+    stats->tracking = now - start;
+    start = now;
+  }
+
+  Glue &glue = workspace.glue;
+  initGlue(tracking, glue, options.glue);
+
+  BlockInfo &rootBlockInfo = workspace.rootBlockInfo;
+  rootBlockInfo.children.clear();
+  rootBlockInfo.locals.clear();
+  workspace.locals.clear();
 
-  State state = {.output = glue.init,
+  output.append(glue.init);
+
+  if (stats != nullptr) {
+    const clock::time_point now = clock::now();
+    stats->glue = now - start;
+    start = now;
+  }
+
+  State state = {.output = output,
                  .totalLocals = glue.nameIndex,
+                 .glueNames = glue.nameIndex,
+                 .tracking = tracking,
                  .globals = glue.globals,
                  .strings = glue.strings,
-                 .blockInfo = &rootBlockInfo};
+                 .blockInfo = &rootBlockInfo,
+                 .locals = workspace.locals,
+                 .compactFalse = options.compactFalse};
+
+  if (workers <= 1 || !emitParallel(root, state, workers)) {
+    handleNode(root, state);
+  }
 
-  handleNode(root, state);
+  if (stats != nullptr) {
+    stats->emit = clock::now() - start;
+    stats->globals = glue.globals.size();
+    stats->strings = glue.hoistedStrings;
+    stats->locals =
+        std::max(state.highestLocal, glue.nameIndex) - glue.nameIndex;
+    stats->removed = tracking.removedStatements();
+  }
+}
+
+std::string processAstRoot(Luau::AstStatBlock *root) {
+  Output output;
+  processAstRoot(root, output);
 
-  return state.output;
+  return output.take();
 }
@@ -2,9 +2,36 @@
 
 #include <Luau/Ast.h>
 #include <ankerl/unordered_dense.h>
+#include <chrono>
 #include <cstddef>
+#include <functional>
+#include <string>
+#include <utility>
 
-typedef ankerl::unordered_dense::map<const char *, std::string> rename_map;
+#include "identifier.h"
+#include "memory.h"
+
+typedef ankerl::unordered_dense::map<
+    const char *, Identifier, ankerl::unordered_dense::hash<const char *>,
+    std::equal_to<const char *>,
+    AccountingAllocator<std::pair<const char *, Identifier>,
+                        MemorySubsystem::RenameMaps>>
+    rename_map;
+
+struct RenamedLocal {
+  Identifier name = {};
+  size_t index = 0; // name == getNameAtIndex(index)
+};
+
+// Renamed locals by declaration. Every AstLocal is unique, so references
+// resolve with one lookup, whatever the nesting and shadowing.
+typedef ankerl::unordered_dense::map<
+    const Luau::AstLocal *, RenamedLocal,
+    ankerl::unordered_dense::hash<const Luau::AstLocal *>,
+    std::equal_to<const Luau::AstLocal *>,
+    AccountingAllocator<std::pair<const Luau::AstLocal *, RenamedLocal>,
+                        MemorySubsystem::RenameMaps>>
+    local_rename_map;
 
 // Block as in, function bodies, while loop bodies, for loop bodies, do bodies,
 // etc.
@@ -14,16 +41,91 @@ struct BlockInfo {
   rename_map locals = {};
 };
 
+#include "output.h"
 #include "tracking.h"
 
 struct State {
-  std::string output = "";
+  Output &output;
 
+  // the index of the last local name given out in the current scope. Every
+  // scope numbers its locals from right above the outer locals it refers to,
+  // and gives the numbers back once it ends (see enterScope)
   size_t totalLocals = 0;
+  size_t glueNames = 0;    // names taken by the glue, locals come after
+  size_t highestLocal = 0; // the highest index given to a local so far
 
-  rename_map &globals;
-  string_map &strings;
+  // globals and strings are renamed by their ids in tracking
+  const AstTracking &tracking;
+  const symbol_renames &globals;
+  const symbol_renames &strings;
   BlockInfo *blockInfo; // MUST NOT BE NULL
+
+  // every local declared so far; blockInfo's names are only needed for locals
+  // whose declaration was not emitted (see processAstRootIncremental)
+  local_rename_map &locals;
+
+  bool compactFalse = true; // false is written as 1==0
+};
+
+void handleNode(const Luau::AstNode *node, State &state);
+
+// Emits one statement of a block. Blocks are emitted by handleNode as bodies,
+// so a block in statement position (a do block) has to go through this.
+void handleStatement(const Luau::AstStat *statement, State &state);
+
+// Names the root locals a top-level statement declares, as emitting it with
+// the local counter at entry would, without emitting it.
+void declareRootLocals(const Luau::AstStat *statement, size_t entry,
+                       const AstTracking &tracking, local_rename_map &locals,
+                       rename_map &names);
+
+// Time spent in each phase of processAstRoot, and what it produced. Only
+// measured when a MinifyStats is passed.
+struct MinifyStats {
+  std::chrono::nanoseconds tracking = {}; // AstTracking
+  std::chrono::nanoseconds glue = {};     // initGlue
+  std::chrono::nanoseconds emit = {};     // handleNode
+
+  size_t globals = 0; // renamed globals
+  size_t strings = 0; // hoisted strings
+  size_t locals = 0;  // distinct local names
+
+  // dead statements left out (see AstTracking::trackScopes), and their bytes
+  // of source (only known to callers which have the source, see Minifier)
+  size_t removed = 0;
+  size_t removedBytes = 0;
+
+  // processAstRootCompressed only: the output's estimated compressed size,
+  // and the raw and compressed sizes with EmitOptions' defaults
+  size_t compressed = 0;
+  size_t defaultRaw = 0;
+  size_t defaultCompressed = 0;
+};
+
+// Containers processAstRoot fills on every run. Callers which minify many
+// sources keep one around (see Minifier), it is cleared rather than freed
+// between runs, so that the maps keep their capacity.
+struct MinifyWorkspace {
+  AstTracking tracking = {};
+  Glue glue = {};
+  BlockInfo rootBlockInfo = {};
+  local_rename_map locals = {};
+};
+
+// Choices which trade raw size for compressibility, see
+// processAstRootCompressed. The defaults give the smallest raw output.
+struct EmitOptions {
+  GlueOptions glue = {};
+  bool compactFalse = true;
 };
 
+// Emits the minified root into output, which flushes to its sink (if any) while
+// the code is being emitted. With more than one worker, large sources have
+// their top-level statements emitted in parallel; the output is identical.
+void processAstRoot(Luau::AstStatBlock *root, Output &output,
+                    MinifyStats *stats = nullptr);
+void processAstRoot(Luau::AstStatBlock *root, Output &output,
+                    MinifyWorkspace &workspace, MinifyStats *stats = nullptr,
+                    size_t workers = 1,
+                    const EmitOptions &options = EmitOptions());
 std::string processAstRoot(Luau::AstStatBlock *root);
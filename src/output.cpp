@@ -0,0 +1,56 @@
+#include <cerrno>
+#include <utility>
+
+#include "output.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+void FdSink::write(std::string_view chunk) {
+  while (!chunk.empty() && !failed) {
+#ifdef _WIN32
+    auto written = ::_write(fd, chunk.data(), (unsigned int)chunk.size());
+#else
+    auto written = ::write(fd, chunk.data(), chunk.size());
+#endif
+
+    if (written < 0) {
+      failed = errno != EINTR;
+      continue;
+    }
+
+    chunk.remove_prefix(written);
+  }
+}
+
+void Output::flush() {
+  if (sink == nullptr || buffer.empty()) {
+    return;
+  }
+
+  sink->write(buffer);
+
+  flushed += buffer.size();
+  last = buffer.back();
+
+  // keeps the capacity, so the next chunk is written without allocating
+  buffer.clear();
+}
+
+std::string Output::take() {
+  if (!buffer.empty()) {
+    flushed += buffer.size();
+    last = buffer.back();
+  }
+
+  // the taken string is not ours to account for anymore
+  if (accounted != 0) {
+    recordRelease(MemorySubsystem::Output, accounted);
+    accounted = 0;
+  }
+
+  return std::exchange(buffer, std::string());
+}
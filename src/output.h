@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "memory.h"
+
+// Destination for emitted code, receives the output in order as chunks.
+class OutputSink {
+public:
+  virtual ~OutputSink() = default;
+
+  virtual void write(std::string_view chunk) = 0;
+};
+
+// Writes chunks straight to a file descriptor (buffering happens in Output).
+class FdSink : public OutputSink {
+public:
+  explicit FdSink(int fd) : fd(fd) {}
+
+  void write(std::string_view chunk) override;
+
+  // false once any write has failed
+  bool good() const { return !failed; }
+
+private:
+  int fd;
+  bool failed = false;
+};
+
+// Hands chunks to a user callback, e.g. for embedding hosts.
+class CallbackSink : public OutputSink {
+public:
+  explicit CallbackSink(std::function<void(std::string_view)> callback)
+      : callback(std::move(callback)) {}
+
+  void write(std::string_view chunk) override { callback(chunk); }
+
+private:
+  std::function<void(std::string_view)> callback;
+};
+
+// Append-only output buffer which handleNode writes through. Without a sink
+// it is a plain string builder (see reserve() and take()). With a sink,
+// every CHUNK_SIZE bytes are flushed to it as they are emitted, so the whole
+// output never has to be held in memory.
+class Output {
+public:
+  static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+  explicit Output(OutputSink *sink = nullptr) : sink(sink) {}
+  Output(const Output &) = delete;
+  Output &operator=(const Output &) = delete;
+  ~Output() {
+    if (accounted != 0) {
+      recordRelease(MemorySubsystem::Output, accounted);
+    }
+  }
+
+  void reserve(size_t size) {
+    buffer.reserve(size);
+    accountGrowth();
+  }
+
+  void append(std::string_view string) {
+    buffer.append(string);
+    accountGrowth();
+    flushIfFull();
+  }
+
+  void append(size_t count, char character) {
+    buffer.append(count, character);
+    accountGrowth();
+    flushIfFull();
+  }
+
+  // last emitted character, including characters already flushed
+  char back() const { return buffer.empty() ? last : buffer.back(); }
+  bool empty() const { return buffer.empty() && flushed == 0; }
+
+  // total amount of bytes emitted, including flushed ones
+  size_t size() const { return flushed + buffer.size(); }
+
+  // bytes which have not been handed to the sink yet
+  std::string_view pending() const { return buffer; }
+
+  // addWhitespaceIfNeeded on an empty output appends nothing, but text which
+  // is spliced in after other text later on (see processAstRoot) has to know
+  // that whitespace was asked for before its first byte
+  void requestLeadingWhitespace() { leadingWhitespace = true; }
+  bool leadingWhitespaceRequested() const { return leadingWhitespace; }
+
+  // hands pending bytes to the sink, no-op without one
+  void flush();
+
+  // moves the pending bytes out, leaving the buffer empty
+  std::string take();
+
+  // starts over with a new sink, keeping the buffer's capacity
+  void reset(OutputSink *newSink = nullptr) {
+    buffer.clear();
+    sink = newSink;
+    flushed = 0;
+    last = 0;
+    leadingWhitespace = false;
+  }
+
+private:
+  std::string buffer = "";
+  OutputSink *sink;
+
+  size_t flushed = 0;
+  char last = 0;
+  bool leadingWhitespace = false;
+
+  size_t accounted = 0; // heap bytes reported to memory accounting
+
+  void accountGrowth() {
+    if (!memoryAccountingEnabled()) {
+      return;
+    }
+
+    // short strings live inside the std::string itself
+    const size_t capacity = buffer.capacity() > std::string().capacity()
+                                ? buffer.capacity() + 1
+                                : 0;
+
+    if (capacity != accounted) {
+      recordRelease(MemorySubsystem::Output, accounted);
+      recordAllocation(MemorySubsystem::Output, capacity);
+      accounted = capacity;
+    }
+  }
+
+  void flushIfFull() {
+    if (sink != nullptr && buffer.size() >= CHUNK_SIZE) {
+      flush();
+    }
+  }
+};
@@ -0,0 +1,376 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "driver.h"
+#include "server.h"
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// path of the listening socket, removed again on SIGINT/SIGTERM
+static char boundSocketPath[sizeof(sockaddr_un::sun_path)];
+
+static std::mutex logMutex;
+
+// a client which stops sending halfway through a request gives up its worker
+// after this long
+static constexpr int REQUEST_TIMEOUT_SECONDS = 30;
+
+// Connections with a request ready to be read wait here for a worker, which
+// reads and answers that one request and hands the connection back to the
+// poll loop through idle (waking it up through wakeFd)
+struct RequestQueue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<int> ready = {};
+  std::vector<int> idle = {};
+  int wakeFd = -1;
+  bool closed = false; // workers finish what's queued, then return
+};
+
+static bool readExact(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t received = recv(fd, data, size, 0);
+
+    if (received < 0 && errno == EINTR) {
+      continue;
+    } else if (received <= 0) {
+      return false;
+    }
+
+    data += received;
+    size -= received;
+  }
+
+  return true;
+}
+
+static bool writeExact(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t sent = send(fd, data, size, 0);
+
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    } else if (sent <= 0) {
+      return false;
+    }
+
+    data += sent;
+    size -= sent;
+  }
+
+  return true;
+}
+
+static void appendBigEndian(std::string &output, uint64_t value, size_t bytes) {
+  for (size_t index = bytes; index > 0; index--) {
+    output.push_back((char)((value >> ((index - 1) * 8)) & 0xff));
+  }
+}
+
+static bool sendResponse(int fd, ServerStatus status,
+                         std::chrono::nanoseconds latency,
+                         const std::string &payload) {
+  std::string header;
+  header.push_back((char)status);
+  appendBigEndian(header, latency.count(), 8);
+  appendBigEndian(header, payload.size(), 4);
+
+  return writeExact(fd, header.data(), header.size()) &&
+         writeExact(fd, payload.data(), payload.size());
+}
+
+// Answers the one request waiting on fd, returns false if the connection
+// should be closed
+static bool serveRequest(int fd, const ResultCache *cache) {
+  unsigned char header[5];
+
+  if (!readExact(fd, (char *)header, sizeof(header))) {
+    return false;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+
+  const uint8_t mode = header[0];
+  const uint32_t length = ((uint32_t)header[1] << 24) |
+                          ((uint32_t)header[2] << 16) |
+                          ((uint32_t)header[3] << 8) | (uint32_t)header[4];
+
+  if (length > MAX_SERVER_REQUEST_SIZE) {
+    sendResponse(fd, ServerStatus::BadRequest,
+                 std::chrono::steady_clock::now() - start, "request too large");
+    return false;
+  }
+
+  std::string source(length, '\0');
+  if (!readExact(fd, source.data(), length)) {
+    return false;
+  }
+
+  ServerStatus status = ServerStatus::Ok;
+  std::string payload;
+
+  if (mode != (uint8_t)ServerMode::Minify &&
+      mode != (uint8_t)ServerMode::Dotviz) {
+    status = ServerStatus::BadRequest;
+    payload = "unknown mode";
+  } else {
+    const OutputMode outputMode = mode == (uint8_t)ServerMode::Minify
+                                      ? OutputMode::Minify
+                                      : OutputMode::Dotviz;
+    PipelineResult result = runPipeline(source, outputMode, nullptr, cache);
+
+    if (!result.errors.empty()) {
+      status = ServerStatus::ParseError;
+
+      for (const auto &error : result.errors) {
+        payload.append(error);
+        payload.append("\n");
+      }
+    } else {
+      payload = std::move(result.output);
+    }
+  }
+
+  const auto latency = std::chrono::steady_clock::now() - start;
+  const bool sent = sendResponse(fd, status, latency, payload);
+
+  {
+    std::lock_guard<std::mutex> lock(logMutex);
+    fprintf(stderr, "%s %u bytes -> %zu bytes, status %d, %.3fms\n",
+            mode == (uint8_t)ServerMode::Dotviz ? "dotviz" : "minify", length,
+            payload.size(), (int)status,
+            std::chrono::duration<double, std::milli>(latency).count());
+  }
+
+  return sent;
+}
+
+// A worker serves one request at a time, with its thread's Minifier
+static void serveRequests(RequestQueue &queue, const ResultCache *cache) {
+  while (true) {
+    int fd;
+
+    {
+      std::unique_lock<std::mutex> lock(queue.mutex);
+      queue.changed.wait(lock,
+                         [&] { return queue.closed || !queue.ready.empty(); });
+
+      if (queue.ready.empty()) {
+        return;
+      }
+
+      fd = queue.ready.front();
+      queue.ready.pop_front();
+    }
+
+    if (!serveRequest(fd, cache)) {
+      close(fd);
+      continue;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.idle.push_back(fd);
+    }
+
+    const char wake = 0;
+    while (write(queue.wakeFd, &wake, 1) < 0 && errno == EINTR) {
+    }
+  }
+}
+
+// Polls the listener and every idle connection, queueing each connection
+// with a request to read for the workers until it is handed back. Returns
+// once polling fails, leaving the connections it holds in idle.
+static void pollConnections(int listener, int wakeFd, RequestQueue &queue) {
+  std::vector<int> idle;
+
+  while (true) {
+    std::vector<pollfd> polled = {{.fd = listener, .events = POLLIN},
+                                  {.fd = wakeFd, .events = POLLIN}};
+
+    for (int fd : idle) {
+      polled.push_back({.fd = fd, .events = POLLIN});
+    }
+
+    if (poll(polled.data(), polled.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      perror("poll");
+      break;
+    }
+
+    std::vector<int> ready;
+    idle.clear();
+
+    for (size_t index = 2; index < polled.size(); index++) {
+      // hangups and errors are queued too, the worker's read sees them and
+      // closes the connection
+      (polled[index].revents != 0 ? ready : idle).push_back(polled[index].fd);
+    }
+
+    if (polled[0].revents & POLLIN) {
+      int connection = accept(listener, nullptr, nullptr);
+
+      if (connection >= 0) {
+        const timeval timeout = {.tv_sec = REQUEST_TIMEOUT_SECONDS};
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                   sizeof(timeout));
+        idle.push_back(connection);
+      } else if (errno != EINTR && errno != ECONNABORTED) {
+        perror("accept");
+        break;
+      }
+    }
+
+    if (polled[1].revents & POLLIN) {
+      char drained[64];
+      while (read(wakeFd, drained, sizeof(drained)) > 0) {
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      idle.insert(idle.end(), queue.idle.begin(), queue.idle.end());
+      queue.idle.clear();
+      queue.ready.insert(queue.ready.end(), ready.begin(), ready.end());
+    }
+
+    for (size_t index = 0; index < ready.size(); index++) {
+      queue.changed.notify_one();
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  queue.idle.insert(queue.idle.end(), idle.begin(), idle.end());
+}
+
+static void handleTerminationSignal(int signal) {
+  unlink(boundSocketPath);
+  _exit(128 + signal);
+}
+
+int runServer(const std::string &socketPath, const ResultCache *cache,
+              size_t workers) {
+  if (socketPath.size() >= sizeof(boundSocketPath)) {
+    std::cerr << "socket path is too long: " << socketPath << std::endl;
+    return 1;
+  }
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0) {
+    perror("socket");
+    return 1;
+  }
+
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+  // a previous server might not have been able to clean up after itself,
+  // anything but a socket is left alone (and bind fails on it)
+  struct stat existing;
+  if (lstat(socketPath.c_str(), &existing) == 0 &&
+      S_ISSOCK(existing.st_mode)) {
+    unlink(socketPath.c_str());
+  }
+
+  if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0) {
+    perror("bind");
+    close(listener);
+    return 1;
+  }
+
+  if (listen(listener, SOMAXCONN) != 0) {
+    perror("listen");
+    close(listener);
+    unlink(socketPath.c_str());
+    return 1;
+  }
+
+  strncpy(boundSocketPath, socketPath.c_str(), sizeof(boundSocketPath) - 1);
+  signal(SIGINT, handleTerminationSignal);
+  signal(SIGTERM, handleTerminationSignal);
+
+  // clients hanging up mid-response must not kill the server
+  signal(SIGPIPE, SIG_IGN);
+
+  if (workers == 0) {
+    workers = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // workers write to the pipe to wake the poll loop up when they hand a
+  // connection back
+  int wakePipe[2];
+  if (pipe(wakePipe) != 0) {
+    perror("pipe");
+    close(listener);
+    unlink(socketPath.c_str());
+    return 1;
+  }
+
+  fcntl(wakePipe[0], F_SETFL, O_NONBLOCK);
+
+  RequestQueue queue;
+  queue.wakeFd = wakePipe[1];
+  std::vector<std::thread> threads;
+
+  for (size_t index = 0; index < workers; index++) {
+    threads.emplace_back(serveRequests, std::ref(queue), cache);
+  }
+
+  fprintf(stderr, "listening on %s (%zu workers)\n", socketPath.c_str(),
+          workers);
+
+  pollConnections(listener, wakePipe[0], queue);
+
+  close(listener);
+  unlink(socketPath.c_str());
+
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.closed = true;
+  }
+
+  queue.changed.notify_all();
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  for (int fd : queue.idle) {
+    close(fd);
+  }
+
+  close(wakePipe[0]);
+  close(wakePipe[1]);
+
+  return 1;
+}
+#else
+int runServer(const std::string &socketPath, const ResultCache *cache,
+              size_t workers) {
+  std::cerr << "server mode is not supported on this platform" << std::endl;
+  return 1;
+}
+#endif
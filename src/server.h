@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "cache.h"
+
+/*
+  Long-running server mode, which accepts requests over a Unix domain socket.
+  Process startup (Luau flags, each thread's Minifier) is only paid once. One
+  thread polls every open connection, and queues each request it sees arrive
+  for a fixed pool of workers, so any number of clients can stay connected
+  while -j requests are served at a time. A connection can send any number of
+  requests, each of which gets exactly one response, in order.
+
+  All integers are big-endian.
+
+  Request:
+    u8   mode   (ServerMode)
+    u32  length
+    u8[] source (length bytes)
+
+  Response:
+    u8   status  (ServerStatus)
+    u64  latency (nanoseconds spent between reading the request and replying)
+    u32  length
+    u8[] payload (minified code or dot graph; newline separated parse errors
+                  on failure)
+*/
+
+enum class ServerMode : uint8_t {
+  Minify = 0,
+  Dotviz = 1,
+};
+
+enum class ServerStatus : uint8_t {
+  Ok = 0,
+  ParseError = 1,
+  BadRequest = 2,
+};
+
+// requests larger than this are answered with ServerStatus::BadRequest, and
+// the connection is closed
+static constexpr uint32_t MAX_SERVER_REQUEST_SIZE = 256 * 1024 * 1024;
+
+// Listens on socketPath until SIGINT/SIGTERM, logging each request's latency
+// to stderr. A stale socket at socketPath is replaced, any other file is left
+// alone. workers = 0 uses std::thread::hardware_concurrency(). Returns the
+// process exit code.
+int runServer(const std::string &socketPath,
+              const ResultCache *cache = nullptr, size_t workers = 0);
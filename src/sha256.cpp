@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "sha256.h"
+
+static constexpr uint32_t roundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t rotateRight(uint32_t value, int bits) {
+  return (value >> bits) | (value << (32 - bits));
+}
+
+void Sha256::compress(const unsigned char *block) {
+  uint32_t schedule[64];
+
+  for (size_t index = 0; index < 16; index++) {
+    schedule[index] = ((uint32_t)block[index * 4] << 24) |
+                      ((uint32_t)block[index * 4 + 1] << 16) |
+                      ((uint32_t)block[index * 4 + 2] << 8) |
+                      (uint32_t)block[index * 4 + 3];
+  }
+
+  for (size_t index = 16; index < 64; index++) {
+    const uint32_t previous = schedule[index - 15];
+    const uint32_t earlier = schedule[index - 2];
+
+    schedule[index] = schedule[index - 16] + schedule[index - 7] +
+                      (rotateRight(previous, 7) ^ rotateRight(previous, 18) ^
+                       (previous >> 3)) +
+                      (rotateRight(earlier, 17) ^ rotateRight(earlier, 19) ^
+                       (earlier >> 10));
+  }
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+  for (size_t index = 0; index < 64; index++) {
+    const uint32_t first = h +
+                           (rotateRight(e, 6) ^ rotateRight(e, 11) ^
+                            rotateRight(e, 25)) +
+                           ((e & f) ^ (~e & g)) + roundConstants[index] +
+                           schedule[index];
+    const uint32_t second =
+        (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) +
+        ((a & b) ^ (a & c) ^ (b & c));
+
+    h = g;
+    g = f;
+    f = e;
+    e = d + first;
+    d = c;
+    c = b;
+    b = a;
+    a = first + second;
+  }
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+void Sha256::update(std::string_view data) {
+  const auto *bytes = (const unsigned char *)data.data();
+  size_t size = data.size();
+  length += size;
+
+  // top up a partial block first, then compress whole blocks in place
+  if (buffered > 0) {
+    const size_t taken = std::min(size, buffer.size() - buffered);
+    std::memcpy(buffer.data() + buffered, bytes, taken);
+    buffered += taken;
+    bytes += taken;
+    size -= taken;
+
+    if (buffered < buffer.size()) {
+      return;
+    }
+
+    compress(buffer.data());
+    buffered = 0;
+  }
+
+  for (; size >= buffer.size(); bytes += buffer.size(), size -= buffer.size()) {
+    compress(bytes);
+  }
+
+  std::memcpy(buffer.data(), bytes, size);
+  buffered = size;
+}
+
+std::string Sha256::hex() {
+  const uint64_t bits = length * 8;
+
+  // a one bit, zeros up to 8 bytes before the end of a block, then the length
+  unsigned char padding[72] = {0x80};
+  const size_t zeros = (buffered < 56 ? 56 : 120) - buffered;
+
+  for (size_t index = 0; index < 8; index++) {
+    padding[zeros + index] = (unsigned char)(bits >> ((7 - index) * 8));
+  }
+
+  update(std::string_view((const char *)padding, zeros + 8));
+
+  std::string digest;
+
+  for (uint32_t word : state) {
+    char hex[9];
+    snprintf(hex, sizeof(hex), "%08x", word);
+    digest += hex;
+  }
+
+  return digest;
+}
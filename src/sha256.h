@@ -0,0 +1,29 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// SHA-256 (FIPS 180-4), for cache keys which must not collide and must stay
+// the same across builds and platforms. Feed it with update, any number of
+// times, then call hex once.
+class Sha256 {
+public:
+  void update(std::string_view data);
+
+  // the digest of everything passed to update, as 64 lowercase hex digits
+  std::string hex();
+
+private:
+  void compress(const unsigned char *block);
+
+  std::array<uint32_t, 8> state = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+  };
+  std::array<unsigned char, 64> buffer = {};
+  size_t buffered = 0;
+  uint64_t length = 0; // in bytes
+};
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <ios>
+#include <utility>
+
+#include "source.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr size_t STDIN_BLOCK_SIZE = 1 << 20;
+
+SourceFile::SourceFile(SourceFile &&other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)),
+      buffer(std::move(other.buffer)), size(std::exchange(other.size, 0)),
+      offset(std::exchange(other.offset, 0)) {}
+
+SourceFile &SourceFile::operator=(SourceFile &&other) noexcept {
+  if (this != &other) {
+    release();
+
+    mapping = std::exchange(other.mapping, nullptr);
+    buffer = std::move(other.buffer);
+    size = std::exchange(other.size, 0);
+    offset = std::exchange(other.offset, 0);
+  }
+
+  return *this;
+}
+
+SourceFile::~SourceFile() { release(); }
+
+void SourceFile::release() {
+#ifndef _WIN32
+  if (mapping != nullptr) {
+    munmap(mapping, size);
+  }
+#endif
+
+  mapping = nullptr;
+}
+
+void SourceFile::skipShebang() {
+  const std::string_view contents = text();
+
+  if (contents.starts_with("#!")) {
+    size_t newline = contents.find('\n');
+    offset = (newline == std::string_view::npos) ? size : newline;
+  }
+}
+
+std::optional<SourceFile> SourceFile::open(const std::string &name,
+                                           bool skipShebang) {
+  SourceFile source;
+
+#ifndef _WIN32
+  int fd = ::open(name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return std::nullopt;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    close(fd);
+    return std::nullopt;
+  }
+
+  source.size = info.st_size;
+
+  // mmap() refuses empty mappings, an empty buffer does the same job
+  if (source.size != 0) {
+    void *mapping = mmap(nullptr, source.size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      return std::nullopt;
+    }
+
+    madvise(mapping, source.size, MADV_SEQUENTIAL);
+    source.mapping = static_cast<char *>(mapping);
+  }
+
+  close(fd);
+#else
+  std::ifstream file{name, std::ios_base::binary | std::ios_base::ate};
+  if (!file.is_open()) {
+    return std::nullopt;
+  }
+
+  source.size = file.tellg();
+  source.buffer.resize(source.size);
+
+  file.seekg(0);
+  file.read(source.buffer.data(), source.size);
+  source.size = file.gcount();
+  source.buffer.resize(source.size);
+#endif
+
+  if (skipShebang) {
+    source.skipShebang();
+  }
+
+  return source;
+}
+
+SourceFile SourceFile::readStdin() {
+  SourceFile source;
+
+#ifndef _WIN32
+  // redirected files report their size up front, so one allocation suffices
+  struct stat info;
+  if (fstat(STDIN_FILENO, &info) == 0 && S_ISREG(info.st_mode)) {
+    source.buffer.reserve(info.st_size + 1);
+  }
+#endif
+
+  size_t length = 0;
+
+  while (true) {
+    if (length == source.buffer.size()) {
+      const size_t growth = std::max(length, STDIN_BLOCK_SIZE);
+      source.buffer.resize(std::max(source.buffer.capacity(), length + growth));
+    }
+
+    size_t read = std::fread(source.buffer.data() + length, 1,
+                             source.buffer.size() - length, stdin);
+    length += read;
+
+    if (read == 0) {
+      break;
+    }
+  }
+
+  source.buffer.resize(length);
+  source.size = length;
+  source.skipShebang();
+
+  return source;
+}
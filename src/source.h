@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Source text handed to Luau::Parser::parse without any copies. Files are
+// memory mapped (read into memory where mmap is unavailable), stdin is read
+// in large blocks into a single buffer. A leading shebang line is skipped by
+// offsetting the start of the text; its newline is kept so that line numbers
+// in parse errors stay correct.
+class SourceFile {
+public:
+  SourceFile() = default;
+  SourceFile(SourceFile &&other) noexcept;
+  SourceFile &operator=(SourceFile &&other) noexcept;
+  SourceFile(const SourceFile &) = delete;
+  SourceFile &operator=(const SourceFile &) = delete;
+  ~SourceFile();
+
+  std::string_view text() const {
+    const char *data = mapping != nullptr ? mapping : buffer.data();
+    return std::string_view(data + offset, size - offset);
+  }
+
+  static std::optional<SourceFile> open(const std::string &name,
+                                        bool skipShebang = true);
+  static SourceFile readStdin();
+
+private:
+  char *mapping = nullptr; // nullptr when the text lives in buffer
+  std::string buffer = "";
+  size_t size = 0;
+  size_t offset = 0;
+
+  void skipShebang();
+  void release();
+};
@@ -1,5 +1,19 @@
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "syntax.h"
 
@@ -10,95 +24,333 @@ static constexpr char usableCharacters[USUABLE_CHARACTERS_LENGTH] = {
     'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M',
     'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z'};
 
-const std::string getNameAtIndex(size_t count) {
-  std::string letters;
-  while (count != 0) {
-    count--;
+static constexpr size_t positionOf(char character) {
+  for (size_t index = 0; index < USUABLE_CHARACTERS_LENGTH; index++) {
+    if (usableCharacters[index] == character) {
+      return index;
+    }
+  }
+
+  return 0;
+}
 
-    letters.insert(0, 1, usableCharacters[count % USUABLE_CHARACTERS_LENGTH]);
-    count /= USUABLE_CHARACTERS_LENGTH;
+// where a name sits in the sequence of all names, keywords included
+static constexpr size_t rawIndexOf(std::string_view name) {
+  size_t index = 0;
+
+  for (const char character : name) {
+    index = index * USUABLE_CHARACTERS_LENGTH + positionOf(character) + 1;
   }
 
-  if (isLuauKeyword(letters.c_str())) {
-    letters.insert(0, "_");
+  return index;
+}
+
+static constexpr Identifier rawNameAt(size_t index) {
+  Identifier name;
+
+  while (index != 0) {
+    index--;
+
+    name.characters[name.length++] =
+        usableCharacters[index % USUABLE_CHARACTERS_LENGTH];
+    index /= USUABLE_CHARACTERS_LENGTH;
   }
 
-  return letters;
+  std::reverse(name.characters, name.characters + name.length);
+
+  return name;
 }
 
-static reflex::Matcher stringSafeMatcher(stringSafeRegex, "");
+// raw indices of the Luau keywords, ascending
+static constexpr auto keywordIndices = [] {
+  constexpr std::string_view keywords[] = {
+      "do",    "end",    "while",  "repeat",   "until", "if",
+      "then",  "else",   "elseif", "for",      "in",    "function",
+      "local", "return", "break",  "continue", "true",  "false",
+      "nil",   "and",    "or",     "not",
+  };
+
+  std::array<size_t, std::size(keywords)> indices = {};
+
+  for (size_t index = 0; index < indices.size(); index++) {
+    indices[index] = rawIndexOf(keywords[index]);
+  }
 
-void appendRawString(std::string &output, std::string_view string) {
-  static char unsafeByteBuffer[5]; // \x takes 2 bytes; %02x takes 2 bytes; and
-                                   // null byte overhead
+  std::sort(indices.begin(), indices.end());
 
-  std::vector<std::pair<std::pair<std::string, size_t>, bool>> blobs;
+  return indices;
+}();
 
-  // reset the matcher, but preserve the pattern and set input data
-  stringSafeMatcher.input(string.data());
+static constexpr Identifier nameAt(size_t count) {
+  for (const size_t keyword : keywordIndices) {
+    if (keyword > count) {
+      break;
+    }
 
-  while (stringSafeMatcher.find() != 0) {
-    blobs.emplace_back(
-        std::pair(stringSafeMatcher.text(), stringSafeMatcher.first()), true);
+    count++;
   }
 
-  // reset the matcher, but preserve the pattern and set input data
-  stringSafeMatcher.input(string.data());
+  return rawNameAt(count);
+}
 
-  while (stringSafeMatcher.split() != 0) {
-    blobs.emplace_back(
-        std::pair(stringSafeMatcher.text(), stringSafeMatcher.first()), false);
+// every one and two letter name, "do", "if", "in" and "or" excluded
+static constexpr size_t SHORT_NAMES =
+    USUABLE_CHARACTERS_LENGTH +
+    USUABLE_CHARACTERS_LENGTH * USUABLE_CHARACTERS_LENGTH - 4;
+
+static constexpr auto shortNames = [] {
+  std::array<Identifier, SHORT_NAMES + 1> names = {};
+
+  for (size_t count = 1; count < names.size(); count++) {
+    names[count] = nameAt(count);
   }
 
-  std::sort(blobs.begin(), blobs.end(), [](const auto &a, const auto &b) {
-    return a.first.second < b.first.second;
-  });
+  return names;
+}();
 
-  for (const auto &[pair, isStringSafe] : blobs) {
-    if (isStringSafe) {
-      // write all safe string data
-      output.append(pair.first);
-    } else {
-      // if any unsafe bytes are left over, manually encode them
-      for (unsigned char character : pair.first) {
-        // buffer overflow isn't possible thanks to snprintf(),
-        // but character should still be unsigned
-        snprintf(unsafeByteBuffer, sizeof(unsafeByteBuffer), "\\x%02x",
-                 character);
-        output.append(unsafeByteBuffer);
-      }
+Identifier getNameAtIndex(size_t count) {
+  if (count < shortNames.size()) {
+    return shortNames[count];
+  }
+
+  return nameAt(count);
+}
+
+/*
+  Bytes which are written into string literals as they are: printable ASCII
+  (0x20 - 0x7e), except for the literal's quote, backslashes and, in
+  interpolated strings, '{', which are escaped with a backslash. Every other
+  byte becomes \xNN. Bytes are classified 32 (AVX2) or 16 (SSE2) at a time.
+*/
+
+static inline bool isStringSafe(unsigned char character) {
+  return character >= 0x20 && character < 0x7f;
+}
+
+// the characters escaped with a backslash in a literal quoted with quote
+struct EscapedCharacters {
+  char quote;
+  char brace; // same as quote unless quote is '`'
+
+  explicit EscapedCharacters(char quote)
+      : quote(quote), brace(quote == '`' ? '{' : quote) {}
+
+  bool contains(char character) const {
+    return character == quote || character == brace || character == '\\';
+  }
+};
+
+// one bit per byte of a block, for bytes written as \xNN and for bytes
+// written with a backslash
+struct EscapeMasks {
+  uint32_t unsafe;
+  uint32_t escaped;
+};
+
+#if defined(__SSE2__) || defined(_M_X64)
+static inline EscapeMasks escapeMasks16(const char *data,
+                                        const EscapedCharacters &escapes) {
+  const __m128i bytes =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+
+  // signed compares, bytes >= 0x80 are negative and fail the first one
+  const __m128i safe =
+      _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(0x1f)),
+                    _mm_cmplt_epi8(bytes, _mm_set1_epi8(0x7f)));
+
+  const __m128i escaped = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(escapes.quote)),
+                   _mm_cmpeq_epi8(bytes, _mm_set1_epi8(escapes.brace))),
+      _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\')));
+
+  return {~static_cast<uint32_t>(_mm_movemask_epi8(safe)) & 0xffff,
+          static_cast<uint32_t>(_mm_movemask_epi8(escaped))};
+}
+#endif
+
+#if defined(__AVX2__)
+static inline EscapeMasks escapeMasks32(const char *data,
+                                        const EscapedCharacters &escapes) {
+  const __m256i bytes =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+
+  const __m256i safe =
+      _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8(0x1f)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8(0x7f), bytes));
+
+  const __m256i escaped = _mm256_or_si256(
+      _mm256_or_si256(
+          _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(escapes.quote)),
+          _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(escapes.brace))),
+      _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\\')));
+
+  return {~static_cast<uint32_t>(_mm256_movemask_epi8(safe)),
+          static_cast<uint32_t>(_mm256_movemask_epi8(escaped))};
+}
+#endif
+
+// index of the first byte at or after start which is not written as it is,
+// or string.size()
+static size_t findEscape(std::string_view string, size_t start,
+                         const EscapedCharacters &escapes) {
+  const char *data = string.data();
+  const size_t size = string.size();
+  size_t index = start;
+
+#if defined(__AVX2__)
+  for (; index + 32 <= size; index += 32) {
+    const EscapeMasks masks = escapeMasks32(data + index, escapes);
+
+    if (const uint32_t mask = masks.unsafe | masks.escaped) {
+      return index + std::countr_zero(mask);
     }
   }
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+  for (; index + 16 <= size; index += 16) {
+    const EscapeMasks masks = escapeMasks16(data + index, escapes);
+
+    if (const uint32_t mask = masks.unsafe | masks.escaped) {
+      return index + std::countr_zero(mask);
+    }
+  }
+#endif
+
+  for (; index < size; index++) {
+    if (!isStringSafe(data[index]) || escapes.contains(data[index])) {
+      return index;
+    }
+  }
+
+  return size;
 }
 
-size_t calculateEffectiveLength(std::string_view string) {
-  size_t length = 0;
+size_t escapedLength(std::string_view string, char quote) {
+  const EscapedCharacters escapes(quote);
+  const char *data = string.data();
+  const size_t size = string.size();
 
-  // reset the matcher, but preserve the pattern and set input data
-  stringSafeMatcher.input(string.data());
+  size_t index = 0;
+  size_t length = size;
 
-  while (stringSafeMatcher.find() != 0) {
-    length += stringSafeMatcher.size();
+#if defined(__AVX2__)
+  for (; index + 32 <= size; index += 32) {
+    const EscapeMasks masks = escapeMasks32(data + index, escapes);
+    length += 3 * std::popcount(masks.unsafe) + std::popcount(masks.escaped);
   }
+#endif
 
-  // reset the matcher, but also preserve the pattern and input data
-  stringSafeMatcher.input(string.data());
+#if defined(__SSE2__) || defined(_M_X64)
+  for (; index + 16 <= size; index += 16) {
+    const EscapeMasks masks = escapeMasks16(data + index, escapes);
+    length += 3 * std::popcount(masks.unsafe) + std::popcount(masks.escaped);
+  }
+#endif
 
-  while (stringSafeMatcher.split() != 0) {
-    length += 4 * stringSafeMatcher.size();
+  for (; index < size; index++) {
+    if (!isStringSafe(data[index])) {
+      length += 3;
+    } else if (escapes.contains(data[index])) {
+      length += 1;
+    }
   }
 
   return length;
 }
 
-const std::string replaceAll(std::string str, const std::string &from,
-                             const std::string &to) {
-  if (from.empty())
-    return str;
-  size_t start_pos = 0;
-  while ((start_pos = str.find(from, start_pos)) != std::string::npos) {
-    str.replace(start_pos, from.length(), to);
-    start_pos += to.length();
+template <typename T>
+static size_t appendEscapedStringTo(T &output, std::string_view string,
+                                    char quote) {
+  static constexpr char hexDigits[] = "0123456789abcdef";
+
+  const EscapedCharacters escapes(quote);
+
+  // escapes of one run, written in batches
+  char buffer[256];
+
+  size_t written = 0;
+  size_t index = 0;
+
+  while (index < string.size()) {
+    const size_t escape = findEscape(string, index, escapes);
+
+    if (escape != index) {
+      output.append(string.substr(index, escape - index));
+      written += escape - index;
+      index = escape;
+    }
+
+    size_t length = 0;
+
+    for (; index < string.size(); index++) {
+      const unsigned char character = string[index];
+
+      if (!isStringSafe(character)) {
+        buffer[length++] = '\\';
+        buffer[length++] = 'x';
+        buffer[length++] = hexDigits[character >> 4];
+        buffer[length++] = hexDigits[character & 0xf];
+      } else if (escapes.contains(character)) {
+        buffer[length++] = '\\';
+        buffer[length++] = character;
+      } else {
+        break;
+      }
+
+      if (length > sizeof(buffer) - 4) {
+        output.append(std::string_view(buffer, length));
+        written += length;
+        length = 0;
+      }
+    }
+
+    if (length != 0) {
+      output.append(std::string_view(buffer, length));
+      written += length;
+    }
   }
-  return str;
+
+  return written;
+}
+
+size_t appendEscapedString(std::string &output, std::string_view string,
+                           char quote) {
+  return appendEscapedStringTo(output, string, quote);
+}
+
+size_t appendEscapedString(Output &output, std::string_view string,
+                           char quote) {
+  return appendEscapedStringTo(output, string, quote);
+}
+
+std::vector<size_t> getLineOffsets(std::string_view source) {
+  std::vector<size_t> offsets = {0};
+
+  for (size_t index = 0; index < source.size(); index++) {
+    if (source[index] == '\n') {
+      offsets.emplace_back(index + 1);
+    }
+  }
+
+  return offsets;
+}
+
+static size_t getOffset(std::string_view source,
+                        const std::vector<size_t> &lineOffsets,
+                        const Luau::Position &position) {
+  if (position.line >= lineOffsets.size()) {
+    return source.size();
+  }
+
+  return std::min(lineOffsets[position.line] + position.column, source.size());
+}
+
+std::string_view getLocationText(std::string_view source,
+                                 const std::vector<size_t> &lineOffsets,
+                                 const Luau::Location &location) {
+  const size_t begin = getOffset(source, lineOffsets, location.begin);
+  const size_t end = getOffset(source, lineOffsets, location.end);
+
+  return source.substr(begin, end - std::min(begin, end));
 }
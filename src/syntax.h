@@ -3,15 +3,12 @@
 #include <Luau/Ast.h>
 #include <Luau/DenseHash.h>
 #include <ankerl/unordered_dense.h>
-#include <reflex/matcher.h>
 #include <string>
+#include <string_view>
+#include <vector>
 
-static const ankerl::unordered_dense::set<const char *> luauKeywords = {
-    "do",    "end",    "while",  "repeat",   "until", "if",
-    "then",  "else",   "elseif", "for",      "in",    "function",
-    "local", "return", "break",  "continue", "true",  "false",
-    "nil",   "and",    "or",     "not",
-};
+#include "identifier.h"
+#include "output.h"
 
 static const ankerl::unordered_dense::set<char> whitespaceCharacters = {
     ' ', ';', '}', '{', ')', '(', ',', ']', '[', '.',  '=',
@@ -23,34 +20,54 @@ static const char *compoundSymbols[Luau::AstExprBinary::Op__Count] = {
     "~=", "==", "<", "<=", ">",  ">=", " and ", " or ",
 };
 
-inline static bool isLuauKeyword(const char *target) {
-  return luauKeywords.contains(target);
-};
+// not is followed by a space, its operand can start with a name
+inline const char *unarySymbol(Luau::AstExprUnary::Op op) {
+  switch (op) {
+  case Luau::AstExprUnary::Not:
+    return "not ";
+  case Luau::AstExprUnary::Minus:
+    return "-";
+  case Luau::AstExprUnary::Len:
+    return "#";
+  }
+
+  return "";
+}
 
 inline static bool isWhitespaceCharacter(const char character) {
   return whitespaceCharacters.contains(character);
 }
 
-static const std::string stringSafeRegex = reflex::Matcher::convert(
-    "[A-Za-z0-9!@#$%^&*()_+| }{:\"?><\\[\\]\\;\\\\',./\\-`~=]+");
-
-inline void addWhitespaceIfNeeded(std::string &string) {
-  // if the string is empty, then no whitespace is needed
-  if (string.empty()) {
+inline void addWhitespaceIfNeeded(Output &output) {
+  // if the output is empty, then no whitespace is needed
+  if (output.empty()) {
+    output.requestLeadingWhitespace();
     return;
   };
 
-  if (!isWhitespaceCharacter(string.back())) {
-    string.append(" ");
+  if (!isWhitespaceCharacter(output.back())) {
+    output.append(" ");
   }
 }
 
-const std::string getNameAtIndex(size_t count);
+// The count-th short identifier (1 = a, ..., 52 = Z, 53 = aa, ...), with Luau
+// keywords left out of the sequence. 0 is the empty name.
+Identifier getNameAtIndex(size_t count);
+
+// Escapes string for a literal quoted with quote ('"', '\'' or '`'): the quote,
+// backslashes and, for '`', '{' get a backslash, bytes outside printable ASCII
+// are written as \xNN. The quotes themselves are not written. Returns the
+// number of bytes written, which escapedLength computes without writing.
+size_t appendEscapedString(std::string &output, std::string_view string,
+                           char quote);
+size_t appendEscapedString(Output &output, std::string_view string,
+                           char quote);
+size_t escapedLength(std::string_view string, char quote);
 
-// in "str", all references of "from" are replaced with "to"
-const std::string replaceAll(std::string str, const std::string &from,
-                             const std::string &to);
+// byte offset of the start of every line in source
+std::vector<size_t> getLineOffsets(std::string_view source);
 
-// callee's are expected to escape quotes themselves
-void appendRawString(std::string &output, std::string_view string);
-size_t calculateEffectiveLength(std::string_view string);
+// the text of source which location spans, lineOffsets are source's
+std::string_view getLocationText(std::string_view source,
+                                 const std::vector<size_t> &lineOffsets,
+                                 const Luau::Location &location);
@@ -1,354 +1,984 @@
 #include <Luau/Ast.h>
 #include <algorithm>
+#include <cstring>
+#include <functional>
+#include <numeric>
 #include <string>
 #include <string_view>
 
 #include "ankerl/unordered_dense.h"
+#include "graph/arena.hpp"
 #include "graph/block.hpp"
 #include "graph/statement.hpp"
 #include "minifier.h"
 #include "syntax.h"
 #include "tracking.h"
 
-struct TrackingState {
-  Block *currentBlock = nullptr;
+SymbolId AstTracking::internGlobal(const char *name) {
+  const auto [iterator, inserted] =
+      globalIds.try_emplace(name, static_cast<SymbolId>(globalNames.size()));
 
-  global_usage_map globalUses = global_usage_map();
-  string_usage_map stringUses = string_usage_map();
-  size_t totalLocals = 0;
-};
+  if (inserted) {
+    globalNames.emplace_back(name);
+    globalUses.emplace_back(0);
+  }
 
-void trackAstLocalAssignment(const Luau::AstLocal *local,
-                             TrackingState &state) {
-  state.currentBlock->locals[local->name.value].uses++;
+  return iterator->second;
 }
 
-void trackCallWithBlock(TrackingState &state, Block *block,
-                        std::function<void()> closure) {
-  Block *current = state.currentBlock;
+SymbolId AstTracking::internString(std::string_view string) {
+  const auto [iterator, inserted] =
+      stringIds.try_emplace(string, static_cast<SymbolId>(strings.size()));
 
-  current->pushChild(block);
-  block->parent = current;
+  if (inserted) {
+    strings.emplace_back(string);
+    stringUses.emplace_back(0);
+  }
 
-  state.currentBlock = block;
-  closure();
-  state.currentBlock = current;
-};
+  return iterator->second;
+}
+
+SymbolId AstTracking::findGlobal(const char *name) const {
+  const auto iterator = globalIds.find(name);
+  return iterator == globalIds.end() ? NO_SYMBOL : iterator->second;
+}
 
-void traverse(const Luau::AstNode *node, TrackingState &state) {
-  if (node->is<Luau::AstExprGlobal>()) {
-    const auto expr = node->as<Luau::AstExprGlobal>();
-    state.globalUses[expr->name.value]++;
+SymbolId
+AstTracking::findString(const Luau::AstExprConstantString *node) const {
+  const auto visited = stringNodes.find(node);
+  if (visited != stringNodes.end()) {
+    return visited->second;
+  }
 
-    Block *block = state.currentBlock;
+  const auto iterator =
+      stringIds.find(std::string_view(node->value.begin(), node->value.end()));
+  return iterator == stringIds.end() ? NO_SYMBOL : iterator->second;
+}
 
-    while (block->parent != nullptr) {
-      block = block->parent;
-    }
+void AstTracking::clear() {
+  globalNames.clear();
+  globalUses.clear();
+  strings.clear();
+  stringUses.clear();
+
+  globalIds.clear();
+  stringIds.clear();
+  stringNodes.clear();
+  scopeLocals.clear();
+  removed.clear();
+  folds.clear();
+}
 
-    // root shouldn't depend on itself
-    if (block != state.currentBlock)
-      state.currentBlock->dependencies[expr->name.value] = block;
+void AstTracking::foldConstants(Luau::AstNode *node) {
+  findConstantFolds(node, folds);
+}
 
-    return;
+const std::string *AstTracking::folded(const Luau::AstExpr *expr) const {
+  const auto iterator = folds.find(expr);
+  return iterator == folds.end() ? nullptr : &iterator->second;
+}
+
+// Whether evaluating expr can neither have side effects nor fail
+static bool isPure(const Luau::AstExpr *expr) {
+  if (expr->is<Luau::AstExprConstantNil>() ||
+      expr->is<Luau::AstExprConstantBool>() ||
+      expr->is<Luau::AstExprConstantNumber>() ||
+      expr->is<Luau::AstExprConstantString>() ||
+      expr->is<Luau::AstExprLocal>() || expr->is<Luau::AstExprVarargs>() ||
+      expr->is<Luau::AstExprFunction>()) {
+    return true;
+  }
+
+  if (const auto group = expr->as<Luau::AstExprGroup>()) {
+    return isPure(group->expr);
   }
 
-  if (node->is<Luau::AstExprConstantString>()) {
-    const auto expr = node->as<Luau::AstExprConstantString>();
+  // operators on constants which fold can't fail
+  if ((expr->is<Luau::AstExprUnary>() || expr->is<Luau::AstExprBinary>()) &&
+      evaluateConstant(expr)) {
+    return true;
+  }
 
-    const std::string_view view(expr->value.begin(), expr->value.end());
-    state.stringUses[view]++;
+  // not, and and or never call metamethods
+  if (const auto unary = expr->as<Luau::AstExprUnary>()) {
+    return unary->op == Luau::AstExprUnary::Not && isPure(unary->expr);
+  }
 
-    return;
+  if (const auto binary = expr->as<Luau::AstExprBinary>()) {
+    return (binary->op == Luau::AstExprBinary::And ||
+            binary->op == Luau::AstExprBinary::Or) &&
+           isPure(binary->left) && isPure(binary->right);
   }
 
-  if (auto block = node->as<Luau::AstStatBlock>()) {
-    for (const auto &statement : block->body) {
-      if (statement->is<Luau::AstStatBlock>()) {
-        DoBlock *block = new DoBlock();
-        trackCallWithBlock(state, block, [&] { traverse(statement, state); });
-        continue;
+  // nil and NaN keys fail, literals are neither
+  if (const auto table = expr->as<Luau::AstExprTable>()) {
+    for (const auto &item : table->items) {
+      if ((item.key != nullptr &&
+           !item.key->is<Luau::AstExprConstantString>() &&
+           !item.key->is<Luau::AstExprConstantNumber>()) ||
+          !isPure(item.value)) {
+        return false;
       }
-
-      traverse(statement, state);
     }
 
-    return;
+    return true;
   }
 
-  if (node->is<Luau::AstStatExpr>()) {
-    auto stat = node->as<Luau::AstStatExpr>();
+  return false;
+}
 
-    auto trackingStatement = new ExpressionStatement{};
-    trackingStatement->value = stat->expr;
-    state.currentBlock->pushStatement(trackingStatement);
+static bool isJump(const Luau::AstStat *statement) {
+  return statement->is<Luau::AstStatReturn>() ||
+         statement->is<Luau::AstStatBreak>() ||
+         statement->is<Luau::AstStatContinue>();
+}
 
-    traverse(stat->expr, state);
-    return;
+// Walks the scopes of a top-level statement, keeping the open ones on a
+// stack, with the root at the bottom. A reference adds its local to every
+// open scope above the one declaring it, stopping at the first that already
+// has it (so do the ones below). The locals which the statement refers to but
+// doesn't declare are the root's.
+//
+// Also finds the dead code: statements after one which always jumps out of
+// its block are removed without being walked, so that their references
+// don't keep anything alive. Unused locals and the blocks left empty are
+// only known once everything was walked, see finish. Whether the statement
+// itself is dead is left to AstTracking::removeDeadStatements.
+class ScopeTracker : public Luau::AstVisitor {
+public:
+  ScopeTracker(scope_locals_map &scopes,
+               ankerl::unordered_dense::set<const Luau::AstStat *> &removed)
+      : scopes(scopes), removed(removed) {}
+
+  bool visit(Luau::AstExprLocal *node) override {
+    const auto declared = depths.find(node->local);
+    size_t declaredDepth = 0;
+
+    if (declared == depths.end()) {
+      if (rootReferenced.insert(node->local).second) {
+        summary.rootReferences.emplace_back(node->local->name.value);
+      }
+    } else {
+      declaredDepth = declared->second;
+
+      // a local function calling itself doesn't keep it alive
+      if (!openFunctions.contains(node->local)) {
+        uses[node->local]++;
+      }
+    }
+
+    for (size_t depth = open.size(); depth > declaredDepth + 1; depth--) {
+      OpenScope &scope = open[depth - 1];
+
+      if (!scope.seen.insert(node->local).second) {
+        break;
+      }
+
+      scope.locals.emplace_back(node->local);
+    }
+
+    return true;
   }
 
-  if (node->is<Luau::AstExprCall>()) {
-    auto expr = node->as<Luau::AstExprCall>();
-    traverse(expr->func, state);
+  // bodies are walked by their parents, blocks in statement position are do
+  // blocks
+  bool visit(Luau::AstStatBlock *node) override {
+    const bool blockJumps = visitBody(node);
 
-    for (const auto arg : expr->args) {
-      traverse(arg, state);
-    };
+    emptiable.emplace_back(node);
+    jumps = blockJumps;
 
-    return;
+    return false;
   }
 
-  if (node->is<Luau::AstExprFunction>()) {
-    auto expr = node->as<Luau::AstExprFunction>();
-    traverse(expr->body, state);
+  bool visit(Luau::AstStatIf *node) override {
+    node->condition->visit(this);
 
-    for (const auto arg : expr->args) {
-      trackAstLocalAssignment(arg, state);
-    };
+    bool ifJumps = visitBody(node->thenbody);
 
-    return;
+    if (node->elsebody == nullptr) {
+      ifJumps = false;
+    } else if (const auto elseBlock =
+                   node->elsebody->as<Luau::AstStatBlock>()) {
+      ifJumps = visitBody(elseBlock) && ifJumps;
+    } else {
+      node->elsebody->visit(this); // elseif
+      ifJumps = jumps && ifJumps;
+    }
+
+    if (isPure(node->condition)) {
+      emptiable.emplace_back(node);
+    }
+
+    jumps = ifJumps;
+
+    return false;
   }
 
-  if (node->is<Luau::AstExprGroup>()) {
-    auto expr = node->as<Luau::AstExprGroup>();
+  bool visit(Luau::AstExprFunction *node) override {
+    push(node);
 
-    traverse(expr->expr, state);
-    return;
+    for (Luau::AstLocal *arg : node->args) {
+      declare(arg);
+    }
+
+    visitBody(node->body);
+    pop();
+
+    return false;
   }
 
-  if (auto stat = node->as<Luau::AstStatWhile>()) {
-    auto *block = new SingleConditionBlock(SingleConditionBlock::Type::While,
-                                           stat->condition);
+  // the bounds are evaluated outside of the loop, but counting them in
+  // doesn't hurt
+  bool visit(Luau::AstStatFor *node) override {
+    push(node);
+    declare(node->var);
 
-    trackCallWithBlock(state, block, [&] { traverse(stat->body, state); });
-    return;
+    node->from->visit(this);
+    node->to->visit(this);
+
+    if (node->step != nullptr) {
+      node->step->visit(this);
+    }
+
+    visitBody(node->body);
+    pop();
+
+    return false;
   }
 
-  if (auto repeat = node->as<Luau::AstStatRepeat>()) {
-    auto *block = new SingleConditionBlock(SingleConditionBlock::Type::Repeat,
-                                           repeat->condition);
+  bool visit(Luau::AstStatForIn *node) override {
+    push(node);
 
-    trackCallWithBlock(state, block, [&] { traverse(repeat->body, state); });
-    return;
+    for (Luau::AstLocal *var : node->vars) {
+      declare(var);
+    }
+
+    for (Luau::AstExpr *value : node->values) {
+      value->visit(this);
+    }
+
+    visitBody(node->body);
+    pop();
+
+    return false;
   }
 
-  if (auto stat = node->as<Luau::AstStatFor>()) {
-    auto *block = new ForBlock(stat->var, stat->from, stat->to, stat->step);
+  bool visit(Luau::AstStatWhile *node) override {
+    node->condition->visit(this);
+    visitBody(node->body);
 
-    trackCallWithBlock(state, block, [&] { traverse(stat->body, state); });
-    return;
+    return false;
   }
 
-  if (auto stat = node->as<Luau::AstStatForIn>()) {
-    auto *block = new ForInBlock(&stat->vars, &stat->values);
+  // the condition sees the body's locals, even ones declared after a jump,
+  // so the body's statements are all kept
+  bool visit(Luau::AstStatRepeat *node) override {
+    push(node->body);
+    visitBody(node->body, true);
+    node->condition->visit(this);
+    pop();
 
-    trackCallWithBlock(state, block, [&] { traverse(stat->body, state); });
-    return;
+    return false;
   }
 
-  if (auto statement = node->as<Luau::AstStatLocalFunction>()) {
-    auto block =
-        new LocalFunctionBlock{statement->name->name.value,
-                               statement->func->vararg, &statement->func->args};
+  // the variables are only visible after the values
+  bool visit(Luau::AstStatLocal *node) override {
+    for (Luau::AstExpr *value : node->values) {
+      value->visit(this);
+    }
 
-    // ensure this scope can access fn
-    trackAstLocalAssignment(statement->name, state);
-    trackCallWithBlock(state, block, [&] { traverse(statement->func, state); });
+    for (Luau::AstLocal *var : node->vars) {
+      declare(var);
+    }
 
-    return;
+    localStatements.emplace_back(node);
+    return false;
   }
 
-  if (auto statement = node->as<Luau::AstStatFunction>()) {
-    const char *ptr;
+  bool visit(Luau::AstStatLocalFunction *node) override {
+    declare(node->name);
 
-    if (auto global = statement->name->as<Luau::AstExprGlobal>()) {
-      ptr = global->name.value;
-    } else if (auto local = statement->name->as<Luau::AstExprLocal>()->local) {
-      ptr = local->name.value;
-    } else {
-      ptr = "<idk>";
+    openFunctions.insert(node->name);
+    node->func->visit(this);
+    openFunctions.erase(node->name);
+
+    localFunctions.emplace_back(node);
+    return false;
+  }
+
+  StatementScopes walk(Luau::AstStat *statement) {
+    open.push_back({}); // the root, which isn't recorded
+
+    jumps = false;
+    statement->visit(this);
+    summary.jumps = alwaysJumps(statement);
+
+    // the statement's own locals are the root's
+    if (const auto local = statement->as<Luau::AstStatLocal>()) {
+      localStatements.pop_back();
+      summary.pure =
+          std::all_of(local->values.begin(), local->values.end(), isPure);
+    } else if (statement->is<Luau::AstStatLocalFunction>()) {
+      localFunctions.pop_back();
+      summary.pure = true;
     }
 
-    auto block = new LocalFunctionBlock{ptr, statement->func->vararg,
-                                        &statement->func->args};
+    finish();
+    summary.empty = removed.contains(statement);
 
-    traverse(statement->name, state);
-    trackCallWithBlock(state, block, [&] { traverse(statement->func, state); });
+    return std::move(summary);
+  }
 
-    return;
+private:
+  // Removes the locals which are never used (when their values are pure),
+  // then the do blocks and ifs (with pure conditions) left with nothing to
+  // run. emptiable is in post-order, so inner blocks are settled first.
+  void finish() {
+    for (const Luau::AstStatLocalFunction *function : localFunctions) {
+      if (!uses.contains(function->name)) {
+        removed.insert(function);
+      }
+    }
+
+    for (const Luau::AstStatLocal *local : localStatements) {
+      if (std::none_of(local->vars.begin(), local->vars.end(),
+                       [&](const Luau::AstLocal *var) {
+                         return uses.contains(var);
+                       }) &&
+          std::all_of(local->values.begin(), local->values.end(), isPure)) {
+        removed.insert(local);
+      }
+    }
+
+    for (const Luau::AstStat *statement : emptiable) {
+      if (isEmpty(statement)) {
+        removed.insert(statement);
+      }
+    }
   }
 
-  if (auto statement = node->as<Luau::AstStatIf>()) {
-    auto block = new IfStatementBlock();
+  struct OpenScope {
+    const Luau::AstNode *node = nullptr;
+    std::vector<const Luau::AstLocal *> locals = {};
+    ankerl::unordered_dense::set<const Luau::AstLocal *> seen = {};
+  };
 
-    trackCallWithBlock(state, block, [&] {
-      auto thenBlock = new IfBlock();
-      thenBlock->type = IfBlock::Type::Then;
+  scope_locals_map &scopes;
+  ankerl::unordered_dense::set<const Luau::AstStat *> &removed;
 
-      block->thenBody = thenBlock;
+  std::vector<OpenScope> open = {};
+  ankerl::unordered_dense::map<const Luau::AstLocal *, size_t> depths = {};
 
-      trackCallWithBlock(state, thenBlock,
-                         [&] { traverse(statement->thenbody, state); });
+  ankerl::unordered_dense::map<const Luau::AstLocal *, size_t> uses = {};
+  ankerl::unordered_dense::set<const Luau::AstLocal *> openFunctions = {};
+  std::vector<const Luau::AstStatLocal *> localStatements = {};
+  std::vector<const Luau::AstStatLocalFunction *> localFunctions = {};
+  std::vector<const Luau::AstStat *> emptiable = {};
 
-      if (statement->elsebody == nullptr) {
-        return;
-      };
+  ankerl::unordered_dense::set<const Luau::AstLocal *> rootReferenced = {};
+  StatementScopes summary = {};
+
+  // whether the do block or if just walked always jumps
+  bool jumps = false;
+
+  void push(const Luau::AstNode *node) { open.push_back({.node = node}); }
+
+  void pop() {
+    OpenScope &scope = open.back();
+    scopes[scope.node] = std::move(scope.locals);
+    open.pop_back();
+  }
+
+  void declare(const Luau::AstLocal *local) {
+    depths[local] = open.size() - 1;
+  }
+
+  // a block which is its own scope, returns whether it always jumps
+  bool visitBody(Luau::AstStatBlock *body) {
+    push(body);
+    const bool bodyJumps = visitBody(body, false);
+    pop();
+
+    return bodyJumps;
+  }
 
-      if (statement->elsebody->is<Luau::AstStatIf>()) {
-        std::vector<std::pair<Luau::AstStatBlock *, Luau::AstExpr *>> elseifs;
-        Luau::AstStatIf *ptr = statement->elsebody->as<Luau::AstStatIf>();
+  // Walks block's statements, returns whether it always jumps. The statements
+  // after a jump are removed, unless keepDead.
+  bool visitBody(Luau::AstStatBlock *block, bool keepDead) {
+    for (size_t index = 0; index < block->body.size; index++) {
+      Luau::AstStat *statement = block->body.data[index];
 
-        while (ptr != nullptr) {
-          elseifs.emplace_back(ptr->thenbody, ptr->condition);
+      jumps = false;
+      statement->visit(this);
 
-          if (ptr->elsebody == nullptr) {
-            break;
-          }
+      if (!alwaysJumps(statement)) {
+        continue;
+      }
 
-          if (ptr->elsebody->is<Luau::AstStatIf>()) {
-            ptr = ptr->elsebody->as<Luau::AstStatIf>();
-          } else {
-            elseifs.emplace_back(ptr->elsebody->as<Luau::AstStatBlock>(),
-                                 nullptr);
-            break;
-          };
+      for (size_t dead = index + 1; dead < block->body.size; dead++) {
+        if (keepDead) {
+          block->body.data[dead]->visit(this);
+        } else {
+          removed.insert(block->body.data[dead]);
         }
+      }
 
-        for (const auto &[node, condition] : elseifs) {
-          auto newBlock = new IfBlock();
+      return true;
+    }
 
-          if (condition == nullptr) {
-            newBlock->type = IfBlock::Type::Else;
-            block->elseBody = newBlock;
-          } else {
-            newBlock->type = IfBlock::Type::Elseif;
-            block->elseifs.emplace_back(newBlock, condition);
-          }
+    return false;
+  }
 
-          trackCallWithBlock(state, newBlock, [&] { traverse(node, state); });
-        };
-        return;
-      } else {
-        auto elseBlock = new IfBlock();
-        elseBlock->type = IfBlock::Type::Else;
-        block->elseBody = elseBlock;
-
-        trackCallWithBlock(state, elseBlock,
-                           [&] { traverse(statement->elsebody, state); });
-      };
-    });
+  // whether statement, just walked, always jumps out of its block
+  bool alwaysJumps(const Luau::AstStat *statement) const {
+    return isJump(statement) || ((statement->is<Luau::AstStatBlock>() ||
+                                  statement->is<Luau::AstStatIf>()) &&
+                                 jumps);
+  }
 
-    return;
-  };
+  bool isEmpty(const Luau::AstStat *statement) const {
+    if (statement == nullptr || removed.contains(statement)) {
+      return true;
+    }
+
+    if (const auto block = statement->as<Luau::AstStatBlock>()) {
+      return std::all_of(
+          block->body.begin(), block->body.end(),
+          [&](const Luau::AstStat *child) { return removed.contains(child); });
+    }
+
+    if (const auto ifStatement = statement->as<Luau::AstStatIf>()) {
+      return isPure(ifStatement->condition) &&
+             isEmpty(ifStatement->thenbody) && isEmpty(ifStatement->elsebody);
+    }
 
-  if (auto assign = node->as<Luau::AstStatAssign>()) {
-    auto assignStatement = new AssignStatement();
+    return false;
+  }
+};
 
-    const size_t assignments = std::min(assign->values.size, assign->vars.size);
-    for (size_t index = 0; index < assignments; index++) {
-      const auto var = assign->vars.data[index];
-      const auto value = assign->values.data[index];
+void AstTracking::trackScopes(Luau::AstStatBlock *root) {
+  std::vector<StatementScopes> statements;
+  statements.reserve(root->body.size);
 
-      assignStatement->vars.emplace_back(var);
-      assignStatement->values.emplace_back(value);
+  // the statements after one which always jumps are dead, and not walked
+  for (Luau::AstStat *statement : root->body) {
+    statements.emplace_back(trackStatementScopes(statement));
 
-      traverse(var, state);
-      traverse(value, state);
+    if (statements.back().jumps) {
+      break;
     }
+  }
 
-    state.currentBlock->pushStatement(assignStatement);
+  removeDeadStatements(root, statements);
+}
 
-    return;
+StatementScopes AstTracking::trackStatementScopes(Luau::AstStat *statement) {
+  ScopeTracker tracker(scopeLocals, removed);
+  return tracker.walk(statement);
+}
+
+// the root locals a top-level statement declares
+static void forEachRootLocal(const Luau::AstStat *statement,
+                             const std::function<void(const char *)> &call) {
+  if (const auto local = statement->as<Luau::AstStatLocal>()) {
+    for (const Luau::AstLocal *var : local->vars) {
+      call(var->name.value);
+    }
+  } else if (const auto function =
+                 statement->as<Luau::AstStatLocalFunction>()) {
+    call(function->name->name.value);
   }
+}
 
-  if (node->is<Luau::AstStatReturn>()) {
-    auto ret = node->as<Luau::AstStatReturn>();
+void AstTracking::removeDeadStatements(
+    Luau::AstStatBlock *root, const std::vector<StatementScopes> &statements) {
+  size_t live = 0;
+  while (live < statements.size() && !statements[live].jumps) {
+    live++;
+  }
+
+  live = std::min(live + 1, statements.size());
+
+  for (size_t index = live; index < root->body.size; index++) {
+    removed.insert(root->body.data[index]);
+  }
+
+  // a name refers to the last statement before which declared it
+  ankerl::unordered_dense::map<std::string_view, size_t> declarations;
+  std::vector<bool> used(live, false);
 
-    auto trackingStatement = new ReturnStatement{};
+  for (size_t index = 0; index < live; index++) {
+    for (const std::string &name : statements[index].rootReferences) {
+      const auto declaration = declarations.find(name);
 
-    for (const auto value : ret->list) {
-      trackingStatement->values.emplace_back(value);
-      traverse(value, state);
+      if (declaration != declarations.end()) {
+        used[declaration->second] = true;
+      }
     }
 
-    state.currentBlock->pushStatement(trackingStatement);
-    return;
+    forEachRootLocal(root->body.data[index],
+                     [&](const char *name) { declarations[name] = index; });
   }
 
-  if (node->is<Luau::AstStatBreak>()) {
-    auto breakStatement = new BreakStatement{};
-    state.currentBlock->pushStatement(breakStatement);
-    return;
+  for (size_t index = 0; index < live; index++) {
+    const StatementScopes &statement = statements[index];
+
+    if (statement.empty || (statement.pure && !used[index])) {
+      removed.insert(root->body.data[index]);
+    }
   }
+}
 
-  if (node->is<Luau::AstStatContinue>()) {
-    auto continueStatement = new ContinueStatement{};
-    state.currentBlock->pushStatement(continueStatement);
-    return;
+const std::vector<const Luau::AstLocal *> *
+AstTracking::outerLocals(const Luau::AstNode *scope) const {
+  const auto iterator = scopeLocals.find(scope);
+  return iterator == scopeLocals.end() ? nullptr : &iterator->second;
+}
+
+bool AstTracking::isRemoved(const Luau::AstStat *statement) const {
+  return removed.contains(statement);
+}
+
+// sums the source text of the outermost removed statements
+class RemovedText : public Luau::AstVisitor {
+public:
+  RemovedText(const AstTracking &tracking, std::string_view source)
+      : tracking(tracking), source(source),
+        lineOffsets(getLineOffsets(source)) {}
+
+  size_t bytes = 0;
+
+  bool visit(Luau::AstStat *node) override {
+    if (!tracking.isRemoved(node)) {
+      return true;
+    }
+
+    bytes += getLocationText(source, lineOffsets, node->location).size();
+    return false;
   }
 
-  if (auto assign = node->as<Luau::AstStatCompoundAssign>()) {
-    auto compoundAssignStatement = new CompoundAssignStatement{};
-    compoundAssignStatement->op = assign->op;
-    compoundAssignStatement->var = assign->var;
-    compoundAssignStatement->value = assign->value;
-    state.currentBlock->pushStatement(compoundAssignStatement);
+private:
+  const AstTracking &tracking;
+  std::string_view source;
+  std::vector<size_t> lineOffsets;
+};
 
-    traverse(assign->var, state);
-    traverse(assign->value, state);
+size_t AstTracking::removedSourceBytes(Luau::AstStatBlock *root,
+                                       std::string_view source) const {
+  if (removed.empty()) {
+    return 0;
+  }
 
-    return;
+  RemovedText text(*this, source);
+  root->visit(&text);
+
+  return text.bytes;
+}
+
+void AstTracking::declareLocal(const Luau::AstLocal *local) {
+  currentBlock->locals[local->name.value].uses++;
+}
+
+void AstTracking::callWithBlock(Block *block,
+                                const std::function<void()> &closure) {
+  Block *current = currentBlock;
+
+  current->pushChild(block);
+
+  currentBlock = block;
+  closure();
+  currentBlock = current;
+}
+
+// Lets Luau visit node's children (whatever they are) with block as the
+// current block: node is visited again, and its visit override sees that it
+// is being entered and returns true.
+bool AstTracking::visitChildrenInBlock(Luau::AstNode *node, Block *block) {
+  callWithBlock(block, [&] {
+    entering = node;
+    node->visit(this);
+  });
+
+  return false;
+}
+
+bool AstTracking::isEntering(Luau::AstNode *node) {
+  if (node != entering) {
+    return false;
   }
 
-  if (auto local = node->as<Luau::AstStatLocal>()) {
-    auto localAssignStatement = new LocalAssignStatement{};
+  entering = nullptr;
+  return true;
+}
 
-    const size_t assignments = std::min(local->values.size, local->vars.size);
+bool AstTracking::visit(Luau::AstExprGlobal *node) {
+  const SymbolId id = internGlobal(node->name.value);
+  globalUses[id]++;
 
-    for (size_t index = 0; index < assignments; index++) {
-      const auto var = local->vars.data[index];
-      const auto value = local->values.data[index];
+  if (currentBlock == nullptr) {
+    return true;
+  }
 
-      localAssignStatement->vars.emplace_back(var);
-      localAssignStatement->values.emplace_back(value);
+  Block *block = currentBlock;
 
-      if (value->is<Luau::AstExprFunction>()) {
-        auto localFunction = Luau::AstStatLocalFunction(
-            local->location, var, value->as<Luau::AstExprFunction>());
-        traverse(&localFunction, state);
-        continue;
-      };
+  while (block->parent != nullptr) {
+    block = block->parent;
+  }
+
+  // root shouldn't depend on itself
+  if (block != currentBlock)
+    currentBlock->dependencies[node->name.value] = block;
+
+  return true;
+}
+
+bool AstTracking::visit(Luau::AstExprConstantString *node) {
+  const std::string_view view(node->value.begin(), node->value.end());
+  const SymbolId id = internString(view);
+
+  stringNodes[node] = id;
+  stringUses[id]++;
 
-      trackAstLocalAssignment(var, state);
-      traverse(value, state);
+  return true;
+}
+
+// a folded expression is written as its literal, what's inside of it is
+// never emitted
+bool AstTracking::visit(Luau::AstExprUnary *node) {
+  return !folds.contains(node);
+}
+
+bool AstTracking::visit(Luau::AstExprBinary *node) {
+  return !folds.contains(node);
+}
+
+bool AstTracking::visit(Luau::AstExprGroup *node) {
+  return !folds.contains(node);
+}
+
+bool AstTracking::visit(Luau::AstExprLocal *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  const char *localName = node->local->name.value;
+  // not in current scope, find the scope
+
+  if (currentBlock->locals.contains(localName) ||
+      currentBlock->dependencies.contains(localName)) {
+    return true;
+  };
+
+  Block *block = currentBlock;
+
+  while (block != nullptr) {
+    if (block->locals.contains(localName)) {
+      currentBlock->dependencies[localName] = block;
+      return true;
     }
 
-    state.currentBlock->pushStatement(localAssignStatement);
-    return;
+    block = block->parent;
+  }
+
+  return true;
+}
+
+bool AstTracking::visit(Luau::AstExprFunction *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  // arguments are declared before the body can use them
+  for (const auto arg : node->args) {
+    declareLocal(arg);
   };
 
-  if (auto local = node->as<Luau::AstExprLocal>()) {
-    const char *localName = local->local->name.value;
-    // not in current scope, find the scope
+  return true;
+}
+
+bool AstTracking::visit(Luau::AstStatBlock *node) {
+  // dead statements are never emitted, what they use isn't counted
+  if (currentBlock == nullptr) {
+    for (Luau::AstStat *statement : node->body) {
+      if (!removed.contains(statement)) {
+        statement->visit(this);
+      }
+    }
+
+    return false;
+  }
+
+  for (const auto &statement : node->body) {
+    if (statement->is<Luau::AstStatBlock>()) {
+      callWithBlock(new DoBlock(), [&] { statement->visit(this); });
+      continue;
+    }
+
+    statement->visit(this);
+  }
+
+  return false;
+}
+
+bool AstTracking::visit(Luau::AstStatExpr *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  auto trackingStatement = new ExpressionStatement{};
+  trackingStatement->value = node->expr;
+  currentBlock->pushStatement(trackingStatement);
+
+  return true;
+}
+
+bool AstTracking::visit(Luau::AstStatWhile *node) {
+  if (currentBlock == nullptr || isEntering(node)) {
+    return true;
+  }
+
+  return visitChildrenInBlock(
+      node, new SingleConditionBlock(SingleConditionBlock::Type::While,
+                                     node->condition));
+}
+
+bool AstTracking::visit(Luau::AstStatRepeat *node) {
+  if (currentBlock == nullptr || isEntering(node)) {
+    return true;
+  }
+
+  return visitChildrenInBlock(
+      node, new SingleConditionBlock(SingleConditionBlock::Type::Repeat,
+                                     node->condition));
+}
+
+bool AstTracking::visit(Luau::AstStatFor *node) {
+  if (currentBlock == nullptr || isEntering(node)) {
+    return true;
+  }
+
+  return visitChildrenInBlock(
+      node, new ForBlock(node->var, node->from, node->to, node->step));
+}
+
+bool AstTracking::visit(Luau::AstStatForIn *node) {
+  if (currentBlock == nullptr || isEntering(node)) {
+    return true;
+  }
+
+  return visitChildrenInBlock(node,
+                              new ForInBlock(&node->vars, &node->values));
+}
+
+bool AstTracking::visit(Luau::AstStatLocalFunction *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  auto block = new LocalFunctionBlock{node->name->name.value,
+                                      node->func->vararg, &node->func->args};
+
+  // ensure this scope can access fn
+  declareLocal(node->name);
+  callWithBlock(block, [&] { node->func->visit(this); });
+
+  return false;
+}
+
+bool AstTracking::visit(Luau::AstStatFunction *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  const char *ptr;
+
+  if (auto global = node->name->as<Luau::AstExprGlobal>()) {
+    ptr = global->name.value;
+  } else if (auto local = node->name->as<Luau::AstExprLocal>()) {
+    ptr = local->local->name.value;
+  } else {
+    ptr = "<idk>";
+  }
+
+  auto block =
+      new LocalFunctionBlock{ptr, node->func->vararg, &node->func->args};
+
+  node->name->visit(this);
+  callWithBlock(block, [&] { node->func->visit(this); });
+
+  return false;
+}
+
+bool AstTracking::visit(Luau::AstStatIf *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  auto block = new IfStatementBlock();
+
+  callWithBlock(block, [&] {
+    node->condition->visit(this);
+
+    auto thenBlock = new IfBlock();
+    thenBlock->type = IfBlock::Type::Then;
+
+    block->thenBody = thenBlock;
+
+    callWithBlock(thenBlock, [&] { node->thenbody->visit(this); });
 
-    if (state.currentBlock->locals.contains(localName) ||
-        state.currentBlock->dependencies.contains(localName)) {
+    if (node->elsebody == nullptr) {
       return;
     };
 
-    Block *block = state.currentBlock;
+    if (node->elsebody->is<Luau::AstStatIf>()) {
+      std::vector<std::pair<Luau::AstStat *, Luau::AstExpr *>> elseifs;
+      Luau::AstStatIf *ptr = node->elsebody->as<Luau::AstStatIf>();
 
-    while (block != nullptr) {
-      if (block->locals.contains(localName)) {
-        state.currentBlock->dependencies[localName] = block;
-        return;
+      while (ptr != nullptr) {
+        elseifs.emplace_back(ptr->thenbody, ptr->condition);
+
+        if (ptr->elsebody == nullptr) {
+          break;
+        }
+
+        if (ptr->elsebody->is<Luau::AstStatIf>()) {
+          ptr = ptr->elsebody->as<Luau::AstStatIf>();
+        } else {
+          elseifs.emplace_back(ptr->elsebody, nullptr);
+          break;
+        };
       }
 
-      block = block->parent;
-    }
+      for (const auto &[body, condition] : elseifs) {
+        auto newBlock = new IfBlock();
 
-    return;
+        if (condition == nullptr) {
+          newBlock->type = IfBlock::Type::Else;
+          block->elseBody = newBlock;
+        } else {
+          newBlock->type = IfBlock::Type::Elseif;
+          block->elseifs.emplace_back(newBlock, condition);
+
+          condition->visit(this);
+        }
+
+        callWithBlock(newBlock, [&] { body->visit(this); });
+      };
+    } else {
+      auto elseBlock = new IfBlock();
+      elseBlock->type = IfBlock::Type::Else;
+      block->elseBody = elseBlock;
+
+      callWithBlock(elseBlock, [&] { node->elsebody->visit(this); });
+    };
+  });
+
+  return false;
+}
+
+bool AstTracking::visit(Luau::AstStatAssign *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  auto assignStatement = new AssignStatement();
+
+  const size_t assignments = std::min(node->values.size, node->vars.size);
+  for (size_t index = 0; index < assignments; index++) {
+    assignStatement->vars.emplace_back(node->vars.data[index]);
+    assignStatement->values.emplace_back(node->values.data[index]);
+  }
+
+  currentBlock->pushStatement(assignStatement);
+
+  return true;
+}
+
+bool AstTracking::visit(Luau::AstStatReturn *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  auto trackingStatement = new ReturnStatement{};
+
+  for (const auto value : node->list) {
+    trackingStatement->values.emplace_back(value);
+  }
+
+  currentBlock->pushStatement(trackingStatement);
+
+  return true;
+}
+
+bool AstTracking::visit(Luau::AstStatBreak *) {
+  if (currentBlock != nullptr) {
+    currentBlock->pushStatement(new BreakStatement{});
+  }
+
+  return true;
+}
+
+bool AstTracking::visit(Luau::AstStatContinue *) {
+  if (currentBlock != nullptr) {
+    currentBlock->pushStatement(new ContinueStatement{});
+  }
+
+  return true;
+}
+
+bool AstTracking::visit(Luau::AstStatCompoundAssign *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  auto compoundAssignStatement = new CompoundAssignStatement{};
+  compoundAssignStatement->op = node->op;
+  compoundAssignStatement->var = node->var;
+  compoundAssignStatement->value = node->value;
+  currentBlock->pushStatement(compoundAssignStatement);
+
+  return true;
+}
+
+bool AstTracking::visit(Luau::AstStatLocal *node) {
+  if (currentBlock == nullptr) {
+    return true;
+  }
+
+  auto localAssignStatement = new LocalAssignStatement{};
+
+  const size_t assignments = std::min(node->values.size, node->vars.size);
+
+  for (size_t index = 0; index < assignments; index++) {
+    const auto var = node->vars.data[index];
+    const auto value = node->values.data[index];
+
+    localAssignStatement->vars.emplace_back(var);
+    localAssignStatement->values.emplace_back(value);
+
+    declareLocal(var);
+
+    // local x = function() end is tracked as local function x() end
+    if (auto function = value->as<Luau::AstExprFunction>()) {
+      auto block = new LocalFunctionBlock{var->name.value, function->vararg,
+                                          &function->args};
+
+      callWithBlock(block, [&] { value->visit(this); });
+      continue;
+    };
+
+    value->visit(this);
+  }
+
+  // values without a variable are still counted
+  for (size_t index = assignments; index < node->values.size; index++) {
+    node->values.data[index]->visit(this);
   }
+
+  currentBlock->pushStatement(localAssignStatement);
+
+  return false;
 }
 
 const std::string blockTypeToString(Block *type) {
@@ -466,9 +1096,18 @@ const std::string statementTypeToString(Statement *type) {
   return "Unknown";
 }
 
-void generateDotNode(Block *block, std::string &output) {
+// dot node identifiers, numbered in the order the nodes are first seen, so that
+// the graph doesn't depend on where blocks and statements were allocated
+typedef ankerl::unordered_dense::map<const void *, size_t> dot_id_map;
+
+const std::string getDotId(dot_id_map &ids, const void *node) {
+  const auto [iterator, _] = ids.try_emplace(node, ids.size());
+  return std::to_string(iterator->second);
+}
+
+void generateDotNode(Block *block, std::string &output, dot_id_map &ids) {
   // generate unique node identifier
-  std::string nodeId = std::to_string(reinterpret_cast<uintptr_t>(block));
+  std::string nodeId = getDotId(ids, block);
   std::string nodeDefinition = blockTypeToString(block);
 
   if (block->is<LocalFunctionBlock>() || block->is<FunctionBlock>()) {
@@ -504,9 +1143,8 @@ void generateDotNode(Block *block, std::string &output) {
   auto deps = block->dependencies.values();
   for (size_t index = 0; index < deps.size(); index++) {
     const auto dep = deps[index];
-    nodeDefinition += "<dep_" +
-                      std::to_string(reinterpret_cast<uintptr_t>(dep.second)) +
-                      "_" + dep.first + ">";
+    nodeDefinition +=
+        "<dep_" + getDotId(ids, dep.second) + "_" + dep.first + ">";
     nodeDefinition += "importUpvalue " + std::string(dep.first);
 
     if (index < deps.size() - 1) {
@@ -524,8 +1162,7 @@ void generateDotNode(Block *block, std::string &output) {
   for (const bool &isStatement : block->order) {
     if (isStatement) {
       const auto &statement = block->statements[statementIndex++];
-      std::string statementId =
-          std::to_string(reinterpret_cast<uintptr_t>(statement));
+      std::string statementId = getDotId(ids, statement);
 
       std::string label = statementTypeToString(statement);
       auto fields = getFields(statement);
@@ -546,8 +1183,8 @@ void generateDotNode(Block *block, std::string &output) {
     } else {
       // block
       const auto &child = block->children[childIndex++];
-      std::string childId = std::to_string(reinterpret_cast<uintptr_t>(child));
-      generateDotNode(child, output);
+      std::string childId = getDotId(ids, child);
+      generateDotNode(child, output, ids);
 
       output += prefix + last + " -> " + childId + ";\n";
       last = childId;
@@ -556,8 +1193,7 @@ void generateDotNode(Block *block, std::string &output) {
   // generate edges to dependencies
   for (const auto &[dependencyName, dependencySource] : block->dependencies) {
     if (dependencySource != block) {
-      std::string dependencyBlockId =
-          std::to_string(reinterpret_cast<uintptr_t>(dependencySource));
+      std::string dependencyBlockId = getDotId(ids, dependencySource);
       output += prefix + nodeId + ":dep_" + dependencyBlockId + "_" +
                 dependencyName + " -> " + dependencyBlockId + ":local_" +
                 dependencyBlockId + "_" + dependencyName +
@@ -568,17 +1204,16 @@ void generateDotNode(Block *block, std::string &output) {
 }
 
 std::string generateDot(Luau::AstStatBlock *node) {
-  AstTracking t;
-  node->visit(&t);
-  Glue glue = initGlue(t);
+  // the whole graph lives in the arena, and is freed with it
+  GraphArena arena;
+  GraphArena::Scope scope(arena);
 
-  RootBlock block = RootBlock();
+  RootBlock *block = new RootBlock();
 
-  TrackingState state = {
-      .currentBlock = &block,
-  };
+  AstTracking tracking;
+  tracking.currentBlock = block;
 
-  traverse(node, state);
+  node->visit(&tracking);
 
   std::string output = "digraph RootDAG {\n";
 
@@ -588,61 +1223,179 @@ std::string generateDot(Luau::AstStatBlock *node) {
   output += "    node [fontname=\"Helvetica\",style=filled,fillcolor=white];\n";
   output += "    edge [fontname=\"Helvetica\",penwidth=1.2];\n";
 
-  generateDotNode(&block, output);
+  dot_id_map ids;
+  generateDotNode(block, output, ids);
 
   output += "}\n";
 
   return output;
 }
 
-Glue initGlue(AstTracking &tracking) {
-  Glue glue = {};
+// Keeps the maxNames globals and strings which save the most with a name of
+// their own, over being read from the glue table (globals) or written inline
+// (strings). If any global is left over, the table takes the last name.
+// Both lists stay in the order they were in.
+static void
+capGlueNames(const AstTracking &tracking, size_t maxNames,
+             std::vector<SymbolId> &globalOrder,
+             std::vector<std::pair<SymbolId, Identifier>> &strings,
+             std::vector<SymbolId> &tableGlobals) {
+  // the longest name any kept one can get, and a read from the table
+  const ptrdiff_t nameLength = getNameAtIndex(maxNames).size();
+  const ptrdiff_t tableReadLength =
+      nameLength + 2 + std::to_string(globalOrder.size()).size();
+
+  struct Candidate {
+    ptrdiff_t savings;
+    bool global;
+    size_t position; // in globalOrder or strings
+  };
 
-  std::vector<std::pair<const char *, size_t>> globalUses(
-      tracking.globalUses.begin(), tracking.globalUses.end());
+  std::vector<Candidate> candidates;
+  candidates.reserve(globalOrder.size() + strings.size());
 
-  std::vector<std::pair<std::string_view, size_t>> stringUses(
-      tracking.stringUses.begin(), tracking.stringUses.end());
+  // the name and a comma in the glue, against the longer reads; the value is
+  // in the glue either way
+  for (size_t index = 0; index < globalOrder.size(); index++) {
+    const ptrdiff_t uses = tracking.globalUses[globalOrder[index]];
+    candidates.push_back({uses * (tableReadLength - nameLength) -
+                              (nameLength + 1),
+                          true, index});
+  }
 
-  if (globalUses.empty() && stringUses.empty()) {
-    return glue;
-  };
+  // the name, the value and two commas in the glue, against inline copies
+  for (size_t index = 0; index < strings.size(); index++) {
+    const SymbolId id = strings[index].first;
+    const ptrdiff_t uses = tracking.stringUses[id];
+    const ptrdiff_t length = escapedLength(tracking.strings[id], '"') + 2;
+    candidates.push_back({uses * (length - nameLength) -
+                              (nameLength + length + 2),
+                          false, index});
+  }
 
-  std::sort(globalUses.begin(), globalUses.end(),
-            [](const auto &a, const auto &b) { return a.second > b.second; });
+  // ties go to globals, then to the earlier one, for deterministic output
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Candidate &a, const Candidate &b) {
+              if (a.savings != b.savings) {
+                return a.savings > b.savings;
+              }
 
-  std::sort(stringUses.begin(), stringUses.end(),
-            [](const auto &a, const auto &b) { return a.second > b.second; });
+              if (a.global != b.global) {
+                return a.global;
+              }
 
-  std::string output = "local ";
-  std::string originalNameMapping = "=";
+              return a.position < b.position;
+            });
+
+  size_t kept = maxNames;
+
+  for (size_t index = maxNames; index < candidates.size(); index++) {
+    if (candidates[index].global) {
+      kept = maxNames - 1;
+      break;
+    }
+  }
+
+  std::vector<bool> keepGlobal(globalOrder.size(), false);
+  std::vector<bool> keepString(strings.size(), false);
 
-  for (size_t index = 0; index < globalUses.size(); index++) {
-    const char *originalName = globalUses[index].first;
-    const std::string translatedName = getNameAtIndex(index + 1);
+  for (size_t index = 0; index < kept; index++) {
+    const Candidate &candidate = candidates[index];
+    (candidate.global ? keepGlobal : keepString)[candidate.position] = true;
+  }
 
-    output.append(translatedName);
-    originalNameMapping.append(originalName);
-    glue.globals[originalName] = translatedName;
+  std::vector<SymbolId> namedGlobals;
 
-    if (index < globalUses.size() - 1) {
-      output.append(",");
-      originalNameMapping.append(",");
+  for (size_t index = 0; index < globalOrder.size(); index++) {
+    (keepGlobal[index] ? namedGlobals : tableGlobals)
+        .push_back(globalOrder[index]);
+  }
+
+  globalOrder = std::move(namedGlobals);
+
+  size_t write = 0;
+
+  for (size_t index = 0; index < strings.size(); index++) {
+    if (keepString[index]) {
+      strings[write++] = strings[index];
     }
   }
 
-  size_t nameIndex = globalUses.size();
-  std::vector<std::pair<std::string_view, std::string>> profitableStrings;
+  strings.resize(write);
+}
+
+Glue initGlue(AstTracking &tracking, const GlueOptions &options) {
+  Glue glue = {};
+  initGlue(tracking, glue, options);
+
+  return glue;
+}
+
+void initGlue(AstTracking &tracking, Glue &glue, const GlueOptions &options) {
+  // cleared rather than replaced, callers reuse glue between runs
+  glue.globals.clear();
+  glue.strings.clear();
+  glue.init.clear();
+  glue.nameIndex = 0;
+  glue.hoistedStrings = 0;
+
+  const std::vector<size_t> &globalUses = tracking.globalUses;
+  const std::vector<size_t> &stringUses = tracking.stringUses;
+
+  // unaliased globals and inline strings have no entry
+  std::vector<SymbolId> globalOrder(
+      options.aliasGlobals ? globalUses.size() : 0);
+  std::iota(globalOrder.begin(), globalOrder.end(), 0);
+
+  std::vector<SymbolId> stringOrder(
+      options.hoistStrings ? stringUses.size() : 0);
+  std::iota(stringOrder.begin(), stringOrder.end(), 0);
+
+  glue.globals.resize(globalOrder.size());
+  glue.strings.resize(stringOrder.size());
+
+  if (globalOrder.empty() && stringOrder.empty()) {
+    return;
+  };
+
+  // most used first. ties are broken by name (and string contents), so that
+  // the order never depends on the order ids were given out in or on how
+  // std::sort happens to arrange equal elements; the output must be
+  // deterministic. ids are already in order of first use
+  if (options.globalOrder == GlobalOrder::MostUsed) {
+    std::sort(globalOrder.begin(), globalOrder.end(),
+              [&](SymbolId a, SymbolId b) {
+                if (globalUses[a] != globalUses[b]) {
+                  return globalUses[a] > globalUses[b];
+                }
+
+                return strcmp(tracking.globalNames[a],
+                              tracking.globalNames[b]) < 0;
+              });
+  }
+
+  std::sort(stringOrder.begin(), stringOrder.end(),
+            [&](SymbolId a, SymbolId b) {
+              if (stringUses[a] != stringUses[b]) {
+                return stringUses[a] > stringUses[b];
+              }
+
+              return tracking.strings[a] < tracking.strings[b];
+            });
+
+  size_t nameIndex = globalOrder.size();
+  std::vector<std::pair<SymbolId, Identifier>> profitableStrings;
+  size_t profitableLength = 0; // of the hoisted strings, escaped and quoted
 
-  for (size_t index = 0; index < stringUses.size(); index++) {
-    const auto &[string, uses] = stringUses[index];
-    const std::string localName = getNameAtIndex(++nameIndex);
+  for (const SymbolId id : stringOrder) {
+    const std::string_view string = tracking.strings[id];
+    const size_t uses = stringUses[id];
+    const Identifier localName = getNameAtIndex(++nameIndex);
 
     const size_t variableUseCost = localName.size();
     const size_t variableInitCost = variableUseCost + 1; // comma = 1
     const size_t effectiveStringCost =
-        (calculateEffectiveLength(replaceAll(string.data(), "\"", "\\\"")) +
-         2); // quotes = 2
+        escapedLength(string, '"') + 2; // quotes = 2
 
     const size_t regularCost = effectiveStringCost * uses;
 
@@ -650,28 +1403,98 @@ Glue initGlue(AstTracking &tracking) {
         variableInitCost + effectiveStringCost + (uses * variableUseCost);
 
     if (regularCost > withVariablesCost) {
-      profitableStrings.emplace_back(string, localName);
+      profitableStrings.emplace_back(id, localName);
+      profitableLength += effectiveStringCost + 1; // comma = 1
     } else {
       nameIndex--;
     }
   }
 
-  if (!profitableStrings.empty() && !globalUses.empty()) {
+  std::vector<SymbolId> tableGlobals;
+
+  if (globalOrder.size() + profitableStrings.size() > options.maxNames) {
+    capGlueNames(tracking, options.maxNames, globalOrder, profitableStrings,
+                 tableGlobals);
+
+    // the kept strings move down to the names the dropped ones leave, which
+    // are never longer
+    nameIndex = globalOrder.size() + (tableGlobals.empty() ? 0 : 1);
+
+    for (auto &[id, localName] : profitableStrings) {
+      localName = getNameAtIndex(++nameIndex);
+    }
+  }
+
+  // nothing worth hoisting, an empty local statement wouldn't parse
+  if (profitableStrings.empty() && globalOrder.empty() &&
+      tableGlobals.empty()) {
+    return;
+  }
+
+  std::string &output = glue.init;
+  std::string originalNameMapping = "=";
+
+  output.append("local ");
+
+  for (size_t index = 0; index < globalOrder.size(); index++) {
+    const SymbolId id = globalOrder[index];
+    const Identifier translatedName = getNameAtIndex(index + 1);
+
+    output.append(translatedName.view());
+    originalNameMapping.append(tracking.globalNames[id]);
+    glue.globals[id] = translatedName;
+
+    if (index < globalOrder.size() - 1) {
+      output.append(",");
+      originalNameMapping.append(",");
+    }
+  }
+
+  if (!tableGlobals.empty()) {
+    const Identifier tableName = getNameAtIndex(globalOrder.size() + 1);
+
+    if (!globalOrder.empty()) {
+      output.append(",");
+      originalNameMapping.append(",");
+    }
+
+    output.append(tableName.view());
+    originalNameMapping.append("{");
+
+    for (size_t index = 0; index < tableGlobals.size(); index++) {
+      const SymbolId id = tableGlobals[index];
+      const std::string element =
+          std::string(tableName.view()) + "[" + std::to_string(index + 1) + "]";
+
+      originalNameMapping.append(tracking.globalNames[id]);
+      glue.globals[id] = Identifier(element);
+
+      if (index < tableGlobals.size() - 1) {
+        originalNameMapping.append(",");
+      }
+    }
+
+    originalNameMapping.append("}");
+  }
+
+  if (!profitableStrings.empty() &&
+      (!globalOrder.empty() || !tableGlobals.empty())) {
     output.append(",");
     originalNameMapping.append(",");
   }
 
+  originalNameMapping.reserve(originalNameMapping.size() + profitableLength);
+
   for (size_t index = 0; index < profitableStrings.size(); index++) {
-    const auto &[string, localName] = profitableStrings[index];
+    const auto &[id, localName] = profitableStrings[index];
 
-    output.append(localName);
+    output.append(localName.view());
 
     originalNameMapping.append("\"");
-    appendRawString(originalNameMapping,
-                    replaceAll(string.data(), "\"", "\\\""));
+    appendEscapedString(originalNameMapping, tracking.strings[id], '"');
     originalNameMapping.append("\"");
 
-    glue.strings[string] = localName;
+    glue.strings[id] = localName;
 
     if (index < profitableStrings.size() - 1) {
       output.append(",");
@@ -685,7 +1508,5 @@ Glue initGlue(AstTracking &tracking) {
   output.append(";");
 
   glue.nameIndex = nameIndex;
-  glue.init = output;
-
-  return glue;
+  glue.hoistedStrings = profitableStrings.size();
 }
@@ -4,41 +4,200 @@
 #include <Luau/DenseHash.h>
 #include <ankerl/unordered_dense.h>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <string_view>
+#include <vector>
 
-typedef ankerl::unordered_dense::map<const char *, size_t> global_usage_map;
-typedef ankerl::unordered_dense::map<std::string_view, size_t> string_usage_map;
-typedef ankerl::unordered_dense::map<std::string_view, std::string> string_map;
+#include "constant.h"
+#include "identifier.h"
+#include "memory.h"
+
+// Dense ids of globals and string constants, see AstTracking
+typedef uint32_t SymbolId;
+inline constexpr SymbolId NO_SYMBOL = UINT32_MAX;
+
+typedef ankerl::unordered_dense::map<const char *, SymbolId> global_id_map;
+typedef ankerl::unordered_dense::map<std::string_view, SymbolId> string_id_map;
+typedef ankerl::unordered_dense::map<const Luau::AstExprConstantString *,
+                                     SymbolId>
+    string_node_map;
+
+// the outer locals a scope refers to, see AstTracking::trackScopes
+typedef ankerl::unordered_dense::map<const Luau::AstNode *,
+                                     std::vector<const Luau::AstLocal *>>
+    scope_locals_map;
+
+// renamed globals or strings, indexed by SymbolId
+typedef std::vector<
+    Identifier, AccountingAllocator<Identifier, MemorySubsystem::RenameMaps>>
+    symbol_renames;
 
 #include "minifier.h"
 
+class Block;
+
+// What deciding whether a top-level statement is dead needs to know about it,
+// see AstTracking::trackStatementScopes
+struct StatementScopes {
+  bool jumps = false; // always returns, breaks or continues
+  bool empty = false; // a do block or if left with nothing to run
+  bool pure = false;  // a local function, or locals whose values are pure
+
+  // the root locals declared by earlier statements it refers to, by name
+  std::vector<std::string> rootReferences = {};
+};
+
+// The analysis pass: counts the uses of every global and string constant, and
+// when currentBlock is set, builds the Block/Statement graph under it in the
+// same walk (blocks, statements, declared locals and the upvalues each block
+// imports). The minifier only needs the counts and leaves currentBlock unset;
+// generateDot needs both. Graph nodes go to the current GraphArena.
+//
+// Globals and strings are interned to dense ids in the order they are first
+// seen, so that counting and renaming index flat arrays. Every string node's
+// id is kept, the minifier finds it without hashing the contents again.
 class AstTracking : public Luau::AstVisitor {
 public:
-  global_usage_map globalUses = global_usage_map();
-  string_usage_map stringUses = string_usage_map();
+  std::vector<const char *> globalNames = {};
+  std::vector<size_t> globalUses = {};
+
+  std::vector<std::string_view> strings = {};
+  std::vector<size_t> stringUses = {};
+
+  Block *currentBlock = nullptr;
+
+  bool visit(Luau::AstExprGlobal *node) override;
+  bool visit(Luau::AstExprConstantString *node) override;
+  bool visit(Luau::AstExprLocal *node) override;
+  bool visit(Luau::AstExprFunction *node) override;
+  bool visit(Luau::AstExprUnary *node) override;
+  bool visit(Luau::AstExprBinary *node) override;
+  bool visit(Luau::AstExprGroup *node) override;
+
+  bool visit(Luau::AstStatBlock *node) override;
+  bool visit(Luau::AstStatExpr *node) override;
+  bool visit(Luau::AstStatWhile *node) override;
+  bool visit(Luau::AstStatRepeat *node) override;
+  bool visit(Luau::AstStatFor *node) override;
+  bool visit(Luau::AstStatForIn *node) override;
+  bool visit(Luau::AstStatLocalFunction *node) override;
+  bool visit(Luau::AstStatFunction *node) override;
+  bool visit(Luau::AstStatIf *node) override;
+  bool visit(Luau::AstStatAssign *node) override;
+  bool visit(Luau::AstStatReturn *node) override;
+  bool visit(Luau::AstStatBreak *node) override;
+  bool visit(Luau::AstStatContinue *node) override;
+  bool visit(Luau::AstStatCompoundAssign *node) override;
+  bool visit(Luau::AstStatLocal *node) override;
+
+  // ids of new symbols start at 0 uses
+  SymbolId internGlobal(const char *name);
+  SymbolId internString(std::string_view string);
+
+  // NO_SYMBOL if never seen. nodes this didn't visit are found by contents
+  SymbolId findGlobal(const char *name) const;
+  SymbolId findString(const Luau::AstExprConstantString *node) const;
 
-  bool visit(Luau::AstExprGlobal *node) override {
-    globalUses[node->name.value]++;
+  // Records, for every scope under root (blocks, functions and for loops),
+  // the locals declared outside of it that it refers to. A repeat's condition
+  // counts as part of its body. Separate from the visit, as scopes are
+  // matched by declaration rather than through the Block graph, whose
+  // dependencies are keyed by name and can't tell shadowed locals apart.
+  //
+  // The same walk finds the dead code which the minifier leaves out: the
+  // statements after a return, break or continue (or a do block or if which
+  // always runs into one), locals and local functions which are never used
+  // and whose values are pure, and do blocks and ifs with pure conditions
+  // left with nothing to run. Run before visiting root: the globals and
+  // strings only the removed statements use aren't counted.
+  void trackScopes(Luau::AstStatBlock *root);
+
+  // trackScopes in two steps, for callers which remember what the statements
+  // were: the scopes and dead code within one top-level statement, and then
+  // which of root's statements are dead, from what was found for every one of
+  // them (or every one up to the first which jumps)
+  StatementScopes trackStatementScopes(Luau::AstStat *statement);
+  void removeDeadStatements(Luau::AstStatBlock *root,
+                            const std::vector<StatementScopes> &statements);
+
+  // nullptr for scopes trackScopes didn't see
+  const std::vector<const Luau::AstLocal *> *
+  outerLocals(const Luau::AstNode *scope) const;
+
+  bool isRemoved(const Luau::AstStat *statement) const;
+  size_t removedStatements() const { return removed.size(); }
+
+  // bytes of source text of the removed statements, source is what root was
+  // parsed from
+  size_t removedSourceBytes(Luau::AstStatBlock *root,
+                            std::string_view source) const;
+
+  // Finds the constant expressions under node to write as literals, see
+  // findConstantFolds. Run before visiting node, so that the strings and
+  // globals inside of them aren't counted.
+  void foldConstants(Luau::AstNode *node);
+
+  // the literal expr is written as, nullptr if it isn't folded
+  const std::string *folded(const Luau::AstExpr *expr) const;
+
+  // forgets every symbol, scope and fold, for the next source
+  void clear();
+
+private:
+  global_id_map globalIds = {};
+  string_id_map stringIds = {};
+  string_node_map stringNodes = {};
+  scope_locals_map scopeLocals = {};
+  ankerl::unordered_dense::set<const Luau::AstStat *> removed = {};
+  constant_folds folds = {};
+
+  // node whose children visitChildrenInBlock is letting Luau walk
+  Luau::AstNode *entering = nullptr;
+
+  void declareLocal(const Luau::AstLocal *local);
+  void callWithBlock(Block *block, const std::function<void()> &closure);
+  bool visitChildrenInBlock(Luau::AstNode *node, Block *block);
+  bool isEntering(Luau::AstNode *node);
+};
+
+// How initGlue names globals
+enum class GlobalOrder {
+  MostUsed = 0, // shortest names for the most used globals
+  FirstUse,     // in the order the source first uses them
+};
 
-    return true;
-  }
+// Luau allows 200 locals per function and 200 upvalues per closure. Every
+// glue name is a local of the chunk, and an upvalue of every bundled module
+// that uses it, so the glue leaves room for the source's own.
+inline constexpr size_t MAX_GLUE_NAMES = 128;
 
-  bool visit(Luau::AstExprConstantString *node) override {
-    const std::string_view view(node->value.begin(), node->value.end());
-    stringUses[view]++;
+struct GlueOptions {
+  bool aliasGlobals = true; // otherwise globals keep their names
+  bool hoistStrings = true; // otherwise strings are always written inline
+  GlobalOrder globalOrder = GlobalOrder::MostUsed;
 
-    return true;
-  }
+  // past this, only the globals and strings which save the most get a name;
+  // the other strings are written inline and the other globals are read from
+  // a table, which takes one of the names
+  size_t maxNames = MAX_GLUE_NAMES;
 };
 
 struct Glue {
-  rename_map globals = rename_map();
-  string_map strings = string_map();
+  // empty when globals aren't aliased. a global read from the glue table is
+  // renamed to the index expression, e.g. "ab[3]"
+  symbol_renames globals = {};
+  symbol_renames strings = {}; // empty for strings that aren't hoisted
 
   std::string init = "";
-  size_t nameIndex;
+  size_t nameIndex = 0;
+  size_t hoistedStrings = 0;
 };
 
-Glue initGlue(AstTracking &tracking);
+Glue initGlue(AstTracking &tracking,
+              const GlueOptions &options = GlueOptions());
+// reuses glue's containers
+void initGlue(AstTracking &tracking, Glue &glue,
+              const GlueOptions &options = GlueOptions());
 std::string generateDot(Luau::AstStatBlock *node);
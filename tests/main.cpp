@@ -0,0 +1,270 @@
+#include <Luau/ParseOptions.h>
+#include <Luau/Parser.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include "bundle.h"
+#include "incremental.h"
+#include "minifier.h"
+#include "output.h"
+#include "tracking.h"
+
+/*
+  Tests for the minifier, run by ctest. A failed check prints what failed and
+  the rest still run, the exit code is 1 if any failed.
+
+  Golden tests are pairs of files in tests/golden: name.luau is minified and
+  compared to name.expected, ignoring trailing whitespace (which editors
+  strip, and which the output ends with after most statements).
+*/
+
+static size_t failures = 0;
+
+static void check(bool condition, const std::string &test,
+                  const char *description) {
+  if (!condition) {
+    std::fprintf(stderr, "FAILED %s: %s\n", test.c_str(), description);
+    failures++;
+  }
+}
+
+// the parse tree of a source, which lives as long as its allocator
+struct ParsedSource {
+  std::string source;
+  Luau::Allocator allocator;
+  Luau::AstNameTable names;
+  Luau::ParseResult result;
+
+  explicit ParsedSource(std::string text)
+      : source(std::move(text)), names(allocator) {
+    Luau::ParseOptions options;
+    result = Luau::Parser::parse(source.data(), source.size(), names,
+                                 allocator, options);
+  }
+
+  bool good() const { return result.errors.empty(); }
+};
+
+static std::string minify(Luau::AstStatBlock *root, size_t workers) {
+  MinifyWorkspace workspace;
+  Output output;
+  processAstRoot(root, output, workspace, nullptr, workers);
+
+  return output.take();
+}
+
+static std::string trimEnd(std::string text) {
+  while (!text.empty() &&
+         (text.back() == ' ' || text.back() == '\n' || text.back() == '\r')) {
+    text.pop_back();
+  }
+
+  return text;
+}
+
+static std::string readFile(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file),
+                     std::istreambuf_iterator<char>());
+}
+
+// Every golden file goes through a serial run, a parallel one (which falls
+// back to serial, they are small) and two incremental runs, the second one
+// reusing every statement of the first.
+static void testGoldenFiles() {
+  std::vector<std::filesystem::path> inputs;
+  std::error_code error;
+
+  for (const auto &entry :
+       std::filesystem::directory_iterator(MINIFIER_TEST_GOLDEN, error)) {
+    if (entry.path().extension() == ".luau") {
+      inputs.push_back(entry.path());
+    }
+  }
+
+  std::sort(inputs.begin(), inputs.end());
+  check(!inputs.empty(), "golden", "no golden files found");
+
+  for (const std::filesystem::path &input : inputs) {
+    const std::string test = input.filename().string();
+
+    std::filesystem::path expectedPath = input;
+    expectedPath.replace_extension(".expected");
+    const std::string expected = trimEnd(readFile(expectedPath));
+    check(ParsedSource(expected).good(), test, "expected output doesn't parse");
+
+    ParsedSource parsed(readFile(input));
+    check(parsed.good(), test, "doesn't parse");
+
+    if (!parsed.good()) {
+      continue;
+    }
+
+    const std::string serial = minify(parsed.result.root, 1);
+
+    if (trimEnd(serial) != expected) {
+      std::fprintf(stderr, "expected: %s\nactual:   %s\n", expected.c_str(),
+                   trimEnd(serial).c_str());
+    }
+
+    check(trimEnd(serial) == expected, test, "output differs from expected");
+    check(minify(parsed.result.root, 8) == serial, test,
+          "8 workers differ from 1");
+
+    IncrementalState state;
+
+    for (const char *run : {"first incremental run differs from a full run",
+                            "second incremental run differs from a full run"}) {
+      Output output;
+      processAstRootIncremental(parsed.result.root, parsed.source,
+                                parsed.names, state, output);
+
+      check(output.take() == serial, test, run);
+    }
+  }
+}
+
+// A source with enough nodes to be emitted in parallel: root locals used
+// across chunks, local functions and do blocks ending right before a chunk
+// boundary, and dead statements between them.
+static std::string parallelSource(size_t statements) {
+  std::string source;
+
+  for (size_t index = 0; index < statements; index++) {
+    const std::string number = std::to_string(index);
+
+    switch (index % 5) {
+    case 0:
+      source += "local v" + number + " = " +
+                (index < 5 ? number : "v" + std::to_string(index - 5)) +
+                " + " + number + "\n";
+      break;
+    case 1:
+      source += "local function f" + number + "(a) return a .. \"s\" .. " +
+                number + " end\n";
+      break;
+    case 2:
+      source += "print(v" + std::to_string(index - 2) + ", f" +
+                std::to_string(index - 1) + "(" + number + "))\n";
+      break;
+    case 3:
+      source += "do local t = {" + number + ", -" + number +
+                "} t[1] = t[2] - -1 print(t) end\n";
+      break;
+    case 4:
+      source += "local unused" + number + " = " + number + "\n";
+      break;
+    }
+  }
+
+  return source;
+}
+
+// -j 8 must give the same output as -j 1, whether or not the source is large
+// enough to be split up
+static void testParallelOutput() {
+  for (const size_t statements : {10, 20000}) {
+    const std::string test =
+        "parallel output (" + std::to_string(statements) + " statements)";
+
+    ParsedSource parsed(parallelSource(statements));
+    check(parsed.good(), test, "generated source doesn't parse");
+
+    if (!parsed.good()) {
+      continue;
+    }
+
+    const std::string serial = minify(parsed.result.root, 1);
+
+    check(!serial.empty(), test, "serial output is empty");
+    check(minify(parsed.result.root, 8) == serial, test,
+          "8 workers differ from 1");
+    check(minify(parsed.result.root, 3) == serial, test,
+          "3 workers differ from 1");
+  }
+}
+
+// A call for each of count distinct globals, passing two copies of a distinct
+// string, so that every one of them is worth a glue name.
+static std::string manyGlobalsSource(size_t count) {
+  std::string source;
+
+  for (size_t index = 0; index < count; index++) {
+    const std::string number = std::to_string(index);
+    const std::string string = "\"a long string, number " + number + "\"";
+
+    source += "g" + number + "(" + string + ", " + string + ")\n";
+  }
+
+  return source;
+}
+
+// the number of names the glue (at the start of the output) declares
+static size_t glueNames(const std::string &output) {
+  if (output.rfind("local ", 0) != 0) {
+    return 0;
+  }
+
+  const std::string names = output.substr(0, output.find('='));
+  return std::count(names.begin(), names.end(), ',') + 1;
+}
+
+// Luau allows 200 locals per function and 200 upvalues per closure, more
+// distinct globals and strings than that must still give a chunk that
+// compiles
+static void testGlueNameLimit() {
+  const std::string test = "glue name limit";
+  const std::string source = manyGlobalsSource(300);
+
+  ParsedSource parsed(source);
+  check(parsed.good(), test, "generated source doesn't parse");
+
+  if (!parsed.good()) {
+    return;
+  }
+
+  const std::string single = minify(parsed.result.root, 1);
+  check(ParsedSource(single).good(), test, "single file output doesn't parse");
+  check(glueNames(single) <= MAX_GLUE_NAMES, test,
+        "single file glue declares too many names");
+
+  // both modules use every global and string, so each module function
+  // closes over all of the glue
+  Luau::Allocator allocator;
+  Luau::AstNameTable names(allocator);
+  std::vector<BundleModule> modules;
+
+  for (const char *name : {"first", "second"}) {
+    Luau::ParseResult result = Luau::Parser::parse(
+        source.data(), source.size(), names, allocator, Luau::ParseOptions());
+    modules.push_back({.name = name, .root = result.root});
+  }
+
+  Output output;
+  processBundle(modules, output);
+  const std::string bundle = output.take();
+
+  check(ParsedSource(bundle).good(), test, "bundle output doesn't parse");
+  check(glueNames(bundle) <= MAX_GLUE_NAMES, test,
+        "bundle glue declares too many names");
+}
+
+int main() {
+  testParallelOutput();
+  testGlueNameLimit();
+  testGoldenFiles();
+
+  if (failures == 0) {
+    std::printf("all tests passed\n");
+  }
+
+  return failures == 0 ? 0 : 1;
+}